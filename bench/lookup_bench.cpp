@@ -0,0 +1,97 @@
+// Microbenchmark: latência das consultas a um arquivo de consulta (lookup.h),
+// direto sobre o arquivo mapeado. Mede o open() (sem etapa de carga), buscas
+// pontuais de n-gramas presentes e ausentes e buscas por prefixo das N-1
+// primeiras palavras, com página fria (logo após o open) e quente.
+//
+// Uso: ./bench/lookup_bench ARQUIVO [CONSULTAS]
+//      (ex.: ./parallel -n 3 -o /tmp/n3.lookup --format lookup big_bible.txt
+//            ./bench/lookup_bench /tmp/n3.lookup 100000)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "lookup.h"
+
+using namespace std;
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Média e percentis, em microssegundos, de cada consulta medida isoladamente
+static void report(const char* name, vector<double>& times) {
+    sort(times.begin(), times.end());
+    double sum = 0;
+    for (size_t i = 0; i < times.size(); i++) sum += times[i];
+    cout << "  " << name << ": média " << sum / times.size() * 1e6 << " us, p50 " << times[times.size() / 2] * 1e6
+         << " us, p99 " << times[times.size() * 99 / 100] * 1e6 << " us, máx " << times.back() * 1e6 << " us\n";
+}
+
+template <typename Query>
+static vector<double> measure(const vector<string>& queries, Query query, size_t& checksum) {
+    vector<double> times(queries.size());
+    for (size_t q = 0; q < queries.size(); q++) {
+        chrono::steady_clock::time_point t = chrono::steady_clock::now();
+        checksum += query(queries[q]);
+        times[q] = seconds_since(t);
+    }
+    return times;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "Uso: " << argv[0] << " ARQUIVO [CONSULTAS]" << endl;
+        return 1;
+    }
+    size_t num_queries = argc > 2 ? strtoull(argv[2], NULL, 10) : 100000;
+
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    NgramLookup lookup;
+    string error;
+    if (!lookup.open(argv[1], error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    double open_time = seconds_since(t);
+    if (lookup.size() == 0 || num_queries == 0) {
+        cerr << "Arquivo sem n-gramas: " << argv[1] << endl;
+        return 1;
+    }
+    cout << "=== " << argv[1] << " (N=" << lookup.n() << ", " << lookup.size() << " n-gramas) ===\n";
+    cout << "  open: " << open_time * 1e6 << " us\n";
+
+    // Consultas: n-gramas sorteados do arquivo, os mesmos com a última letra
+    // trocada (quase sempre ausentes) e as suas N-1 primeiras palavras
+    mt19937_64 rng(42);
+    vector<string> hits, misses, prefixes;
+    for (size_t q = 0; q < num_queries; q++) {
+        string key(lookup.key(rng() % lookup.size()));
+        hits.push_back(key);
+        string miss = key;
+        miss[miss.length() - 1] = (miss[miss.length() - 1] == 'z') ? 'y' : 'z';
+        misses.push_back(miss);
+        size_t space = key.rfind(' ');
+        prefixes.push_back(space == string::npos ? key : key.substr(0, space));
+    }
+
+    size_t checksum = 0;
+    auto find = [&](const string& q) { return (size_t)lookup.find(q); };
+    auto prefix = [&](const string& q) {
+        pair<size_t, size_t> range = lookup.prefix_range(q);
+        return range.second - range.first;
+    };
+    vector<double> cold = measure(hits, find, checksum);
+    vector<double> warm = measure(hits, find, checksum);
+    vector<double> absent = measure(misses, find, checksum);
+    vector<double> by_prefix = measure(prefixes, prefix, checksum);
+    report("pontual (primeira passada)", cold);
+    report("pontual", warm);
+    report("pontual, ausente", absent);
+    report("prefixo (N-1 palavras)", by_prefix);
+    cout << "  (checksum " << checksum << ")\n";
+    return 0;
+}
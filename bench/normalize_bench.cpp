@@ -0,0 +1,75 @@
+// Microbenchmark: efeito dos modos de normalização de normalize.h no
+// tamanho do vocabulário, no número de n-gramas distintos e no tempo de
+// tokenização.
+//
+// Uso: ./bench/normalize_bench [N] arquivo...
+//      (ex.: ./bench/normalize_bench 5 DomCasmurro.txt)
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "tokenizer.h"
+
+using namespace std;
+
+const int REPEATS = 5; // Vale o melhor tempo de cada modo
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static size_t count_unique_ngrams(const vector<uint32_t>& tokens, const Vocabulary& vocab, int N) {
+    NgramTable table(N);
+    for (size_t i = 0; i + N <= tokens.size(); i++) {
+        uint64_t h = 0;
+        for (int j = 0; j < N; j++) h = h * NGRAM_HASH_BASE + vocab.word_hash(tokens[i + j]);
+        table.add(&tokens[i], h, 1);
+    }
+    return table.size();
+}
+
+int main(int argc, char* argv[]) {
+    int first_file = 1;
+    int N = 5;
+    if (argc > 2 && atoi(argv[1]) > 0) {
+        N = atoi(argv[1]);
+        first_file = 2;
+    }
+    if (first_file >= argc) {
+        cerr << "Uso: " << argv[0] << " [N] arquivo..." << endl;
+        return 1;
+    }
+    TokenizerKind kind = best_tokenizer();
+    const int modes[] = { NORM_ASCII, NORM_UTF8, NORM_UTF8_STRIP };
+
+    for (int a = first_file; a < argc; a++) {
+        ifstream file(argv[a], ios::binary);
+        if (!file.is_open()) {
+            cerr << "Erro ao abrir arquivo: " << argv[a] << endl;
+            return 1;
+        }
+        string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        cout << argv[a] << " (" << text.length() << " bytes, N = " << N << ", tokenizador "
+             << tokenizer_name(kind) << ")\n";
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            double best_time = 1e30;
+            vector<uint32_t> tokens;
+            Vocabulary vocab;
+            for (int r = 0; r < REPEATS; r++) {
+                vocab = Vocabulary();
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                tokens = tokenize_optimized(text, vocab, kind, modes[m]);
+                best_time = min(best_time, seconds_since(start));
+            }
+            cout << "  " << norm_mode_name(modes[m]) << ": " << best_time * 1000 << " ms, "
+                 << text.length() / best_time / 1e9 << " GB/s, " << tokens.size() << " tokens, "
+                 << vocab.size() << " palavras, " << count_unique_ngrams(tokens, vocab, N)
+                 << " n-gramas distintos\n";
+        }
+    }
+    return 0;
+}
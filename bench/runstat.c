@@ -0,0 +1,55 @@
+// Executa um comando e grava o tempo de parede e o pico de memória (RSS) do
+// maior processo da árvore dele, inclusive os ranks lançados pelo mpirun.
+// Usado por bench/scaling.sh, para não depender do /usr/bin/time.
+//
+// Uso: ./bench/runstat arquivo_de_saida comando [args...]
+//      (grava "segundos rss_kb status" em arquivo_de_saida)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Uso: %s arquivo_de_saida comando [args...]\n", argv[0]);
+        return 1;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        execvp(argv[2], argv + 2);
+        perror(argv[2]);
+        _exit(127);
+    }
+
+    // O rusage de wait4 inclui os descendentes já esperados pelo filho; para
+    // ru_maxrss o Linux guarda o maior deles, ou seja, o pico de um processo
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+    FILE *out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+    fprintf(out, "%.6f %ld %d\n", seconds, usage.ru_maxrss, code);
+    fclose(out);
+    return code;
+}
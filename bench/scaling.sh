@@ -0,0 +1,150 @@
+#!/bin/bash
+# Benchmark de escalabilidade: ngrams (serial) contra parallel com
+# mpirun -np P, em entradas de tamanho controlado, com várias repetições.
+#
+# Gera uma linha por (escala, tamanho, programa, P) com a mediana das
+# repetições: tempo de parede, MB/s, n-gramas/s, speedup, eficiência e pico
+# de RSS (do maior processo). Duas escalas:
+#   strong: tamanho fixo (SIZES), P variando; speedup e eficiência em
+#           relação ao serial
+#   weak:   WEAK_MB por processo (entrada de WEAK_MB * P), eficiência =
+#           tempo com o primeiro P de PROCS / tempo com P
+#
+# Uso: make bench   (ou bench/scaling.sh, da raiz do repositório)
+#
+# Variáveis de ambiente (padrões entre parênteses):
+#   SIZES        tamanhos em MB da escala forte ("4 16")
+#   PROCS        valores de P ("1 2 4 8")
+#   WEAK_MB      MB por processo da escala fraca; vazio desliga (4)
+#   TRIALS       repetições de cada medida (3)
+#   ARGS         opções extras do parallel, ex.: "--read blocks --reduce shuffle" ("")
+#   SERIAL_ARGS  opções extras do ngrams, ex.: "--n 3" ("")
+#   MPIRUN       comando do mpirun ("mpirun --oversubscribe")
+#   SOURCE       texto de onde as entradas são geradas (bible.txt se existir,
+#                senão DomCasmurro.txt)
+#   DATA_DIR     onde as entradas geradas ficam (bench/data)
+#   OUT          arquivo de resultado (bench/results.csv)
+#   FORMAT       csv ou json (csv)
+
+set -e
+
+SIZES=${SIZES:-"4 16"}
+PROCS=${PROCS:-"1 2 4 8"}
+WEAK_MB=${WEAK_MB-4}
+TRIALS=${TRIALS:-3}
+ARGS=${ARGS:-}
+SERIAL_ARGS=${SERIAL_ARGS:-}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+DATA_DIR=${DATA_DIR:-bench/data}
+FORMAT=${FORMAT:-csv}
+OUT=${OUT:-bench/results.$FORMAT}
+if [ -z "$SOURCE" ]; then
+    SOURCE=DomCasmurro.txt
+    [ -f bible.txt ] && SOURCE=bible.txt
+fi
+
+for bin in ./ngrams ./parallel ./bench/runstat; do
+    if [ ! -x "$bin" ]; then
+        echo "$bin não encontrado; rode make bench" >&2
+        exit 1
+    fi
+done
+mkdir -p "$DATA_DIR"
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Entrada de $1 MB: o texto-fonte concatenado até passar do tamanho, como a
+# receita do big_bible.txt, e cortado no tamanho exato
+make_input() {
+    local mb=$1 path="$DATA_DIR/input-${1}MB.txt"
+    if [ ! -f "$path" ]; then
+        local bytes=$((mb * 1024 * 1024))
+        : > "$path.tmp"
+        while [ "$(stat -c %s "$path.tmp")" -lt "$bytes" ]; do cat "$SOURCE" >> "$path.tmp"; done
+        head -c "$bytes" "$path.tmp" > "$path"
+        rm -f "$path.tmp"
+    fi
+    echo "$path"
+}
+
+# Roda "$@" TRIALS vezes; deixa a mediana do tempo em M_TIME, o maior pico de
+# RSS em M_RSS e o total de n-gramas do resumo do parallel em M_NGRAMS
+# (vazio para o serial)
+measure() {
+    local t times=""
+    M_RSS=0
+    M_NGRAMS=""
+    for ((t = 0; t < TRIALS; t++)); do
+        if ! ./bench/runstat "$TMP/stat" "$@" > "$TMP/out" 2> "$TMP/err"; then
+            echo "falhou: $*" >&2
+            cat "$TMP/err" >&2
+            exit 1
+        fi
+        read -r seconds kb status < "$TMP/stat"
+        times="$times $seconds"
+        [ "$kb" -gt "$M_RSS" ] && M_RSS=$kb
+        M_NGRAMS=$(sed -n 's/^N-gramas[^:]*: \([0-9]*\).*/\1/p' "$TMP/out" | head -n 1)
+    done
+    M_TIME=$(echo $times | tr ' ' '\n' | sort -g | awk '{ v[NR] = $1 } END { print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }')
+}
+
+# Uma linha do CSV; $ref_time é o tempo de referência do speedup
+emit() {
+    local scale=$1 mb=$2 program=$3 procs=$4 seconds=$5 rss=$6 ngrams=$7 ref_time=$8
+    local args
+    args=$([ "$program" = ngrams ] && echo "$SERIAL_ARGS" || echo "$ARGS")
+    awk -v s="$scale" -v mb="$mb" -v prog="$program" -v p="$procs" -v t="$seconds" -v rss="$rss" \
+        -v ng="$ngrams" -v ref="$ref_time" -v args="${args//,/;}" 'BEGIN {
+        speedup = (t > 0) ? ref / t : 0
+        eff = (s == "weak") ? speedup : speedup / p
+        mb_s = (t > 0) ? mb / t : 0
+        ng_s = (t > 0) ? ng / t : 0
+        printf "%s,%s,%s,%d,%d,%.4f,%.2f,%.0f,%.3f,%.3f,%d\n", s, prog, args, p, mb, t,
+               mb_s, ng_s, speedup, eff, rss
+    }' >> "$TMP/results.csv"
+}
+
+echo "scale,program,args,procs,input_mb,seconds,mb_per_s,ngrams_per_s,speedup,efficiency,max_rss_kb" > "$TMP/results.csv"
+
+for mb in $SIZES; do
+    input=$(make_input "$mb")
+    echo "strong: $input" >&2
+    # O total de n-gramas vem do parallel (o ngrams não o imprime)
+    measure $MPIRUN -np 1 ./parallel $ARGS "$input"
+    ngrams=$M_NGRAMS
+    measure ./ngrams $SERIAL_ARGS "$input"
+    serial_time=$M_TIME
+    emit strong "$mb" ngrams 1 "$M_TIME" "$M_RSS" "$ngrams" "$serial_time"
+    echo "  serial: ${M_TIME}s" >&2
+    for p in $PROCS; do
+        measure $MPIRUN -np "$p" ./parallel $ARGS "$input"
+        emit strong "$mb" parallel "$p" "$M_TIME" "$M_RSS" "$ngrams" "$serial_time"
+        echo "  P=$p: ${M_TIME}s" >&2
+    done
+done
+
+if [ -n "$WEAK_MB" ]; then
+    base_time=""
+    for p in $PROCS; do
+        mb=$((WEAK_MB * p))
+        input=$(make_input "$mb")
+        measure $MPIRUN -np "$p" ./parallel $ARGS "$input"
+        [ -z "$base_time" ] && base_time=$M_TIME
+        emit weak "$mb" parallel "$p" "$M_TIME" "$M_RSS" "$M_NGRAMS" "$base_time"
+        echo "weak: P=$p, $mb MB: ${M_TIME}s" >&2
+    done
+fi
+
+if [ "$FORMAT" = json ]; then
+    awk -F, 'NR == 1 { for (i = 1; i <= NF; i++) key[i] = $i; print "["; next }
+             { printf "%s  {", (NR > 2 ? ",\n" : "")
+               for (i = 1; i <= NF; i++) {
+                   q = (i <= 3) ? "\"" : ""
+                   printf "%s\"%s\": %s%s%s", (i > 1 ? ", " : ""), key[i], q, $i, q
+               }
+               printf "}" }
+             END { print "\n]" }' "$TMP/results.csv" > "$OUT"
+else
+    cp "$TMP/results.csv" "$OUT"
+fi
+echo "Resultados em $OUT" >&2
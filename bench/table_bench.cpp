@@ -0,0 +1,138 @@
+// Microbenchmark: NgramTable (endereçamento aberto + arena) contra o
+// unordered_map<string, int> usado antes, na contagem das folhas e no merge.
+//
+// Uso: ./bench/table_bench [N] arquivo...
+//      (ex.: ./bench/table_bench 5 DomCasmurro.txt big_bible.txt)
+
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ngram_table.h"
+
+using namespace std;
+
+const int NUM_PARTS = 8; // Quantas "folhas" são mescladas no teste de merge
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Mesma regra de tokenização do parallel.cpp/ngrams.c
+static vector<string> read_words(const char* path) {
+    ifstream file(path);
+    stringstream buffer;
+    buffer << file.rdbuf();
+    string text = buffer.str();
+
+    vector<string> words;
+    string word;
+    for (size_t i = 0; i <= text.length(); i++) {
+        char c = (i < text.length()) ? text[i] : ' ';
+        if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+            if (!word.empty()) words.push_back(word);
+            word.clear();
+        } else if (isalpha(c)) {
+            word += tolower(c);
+        }
+    }
+    return words;
+}
+
+static void count_map(const vector<string>& words, size_t begin, size_t end, int N, unordered_map<string, int>& counts) {
+    for (size_t i = begin; i + N <= end; i++) {
+        string ngram = words[i];
+        for (int j = 1; j < N; j++) ngram += " " + words[i + j];
+        counts[ngram]++;
+    }
+}
+
+static void count_table(const vector<string>& words, size_t begin, size_t end, int N, NgramCounts& counts) {
+    vector<uint32_t> ids;
+    ids.reserve(end - begin);
+    for (size_t i = begin; i < end; i++) ids.push_back(counts.vocab.intern(words[i].data(), words[i].length()));
+    for (size_t i = 0; i + N <= ids.size(); i++) {
+        uint64_t h = 0;
+        for (int j = 0; j < N; j++) h = h * NGRAM_HASH_BASE + counts.vocab.word_hash(ids[i + j]);
+        counts.table.add(&ids[i], h, 1);
+    }
+}
+
+static void run(const char* path, int N) {
+    vector<string> words = read_words(path);
+    if (words.size() < (size_t)N) {
+        cerr << "Arquivo sem tokens suficientes: " << path << endl;
+        return;
+    }
+    cout << "\n=== " << path << " (" << words.size() << " tokens, N=" << N << ") ===\n";
+
+    // --- Contagem de uma folha ---
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    unordered_map<string, int> map_counts;
+    count_map(words, 0, words.size(), N, map_counts);
+    double map_time = seconds_since(t);
+
+    t = chrono::steady_clock::now();
+    NgramCounts table_counts(N);
+    count_table(words, 0, words.size(), N, table_counts);
+    double table_time = seconds_since(t);
+
+    if (map_counts.size() != table_counts.table.size()) {
+        cerr << "ERRO: unordered_map tem " << map_counts.size() << " n-gramas e NgramTable "
+             << table_counts.table.size() << endl;
+        exit(1);
+    }
+    cout << "Contagem:  unordered_map " << map_time << " s | NgramTable " << table_time
+         << " s | " << map_time / table_time << "x (" << table_counts.table.size() << " únicos, carga "
+         << table_counts.table.load_factor() << ", " << table_counts.table.memory_bytes() / (1024 * 1024) << " MB)\n";
+
+    // --- Merge de NUM_PARTS folhas, como na subida da árvore ---
+    vector<unordered_map<string, int> > map_parts(NUM_PARTS);
+    vector<NgramCounts> table_parts;
+    for (int p = 0; p < NUM_PARTS; p++) {
+        size_t begin = words.size() * p / NUM_PARTS;
+        size_t end = words.size() * (p + 1) / NUM_PARTS;
+        count_map(words, begin, end, N, map_parts[p]);
+        table_parts.push_back(NgramCounts(N));
+        count_table(words, begin, end, N, table_parts.back());
+    }
+
+    t = chrono::steady_clock::now();
+    unordered_map<string, int> map_merged;
+    for (int p = 0; p < NUM_PARTS; p++) {
+        for (const auto& pair : map_parts[p]) map_merged[pair.first] += pair.second;
+    }
+    double map_merge_time = seconds_since(t);
+
+    t = chrono::steady_clock::now();
+    NgramCounts table_merged(N);
+    for (int p = 0; p < NUM_PARTS; p++) table_merged.merge(table_parts[p]);
+    double table_merge_time = seconds_since(t);
+
+    if (map_merged.size() != table_merged.table.size()) {
+        cerr << "ERRO: merge com tamanhos diferentes" << endl;
+        exit(1);
+    }
+    cout << "Merge x" << NUM_PARTS << ":  unordered_map " << map_merge_time << " s | NgramTable "
+         << table_merge_time << " s | " << map_merge_time / table_merge_time << "x\n";
+}
+
+int main(int argc, char** argv) {
+    int first_file = 1;
+    int N = 5;
+    if (argc > 1 && isdigit(argv[1][0])) {
+        N = atoi(argv[1]);
+        first_file = 2;
+    }
+    if (first_file >= argc) {
+        cerr << "Uso: " << argv[0] << " [N] arquivo..." << endl;
+        return 1;
+    }
+    for (int i = first_file; i < argc; i++) run(argv[i], N);
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Microbenchmark: tokenizador de tokenizer.h (escalar, SSE2, AVX2) contra o
+// laço byte a byte usado antes. Confere também que todas as versões geram
+// exatamente os mesmos tokens e a mesma contagem de tokens próprios.
+//
+// Uso: ./bench/tokenizer_bench arquivo...
+//      (ex.: ./bench/tokenizer_bench DomCasmurro.txt big_bible.txt)
+
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "tokenizer.h"
+
+using namespace std;
+
+const int REPEATS = 5; // Vale o melhor tempo de cada versão
+
+static double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// O tokenizador anterior do parallel.cpp, mantido aqui como referência
+static vector<uint32_t> tokenize_reference(string_view text, Vocabulary& vocab, size_t owned_chars, size_t* owned_tokens) {
+    size_t len = text.length();
+    vector<uint32_t> tokens;
+    char current_word[256];
+    size_t word_len = 0;
+    string long_word;
+    tokens.reserve(len / 5);
+    size_t owned = 0;
+    size_t word_start = 0;
+
+    for (size_t i = 0; i <= len; i++) {
+        char c = (i < len) ? text[i] : ' ';
+        if (is_separator(c)) {
+            if (word_len > 0) {
+                if (word_start < owned_chars) owned++;
+                if (word_len <= sizeof(current_word)) {
+                    tokens.push_back(vocab.intern(current_word, word_len));
+                } else {
+                    tokens.push_back(vocab.intern(long_word.data(), long_word.length()));
+                    long_word.clear();
+                }
+                word_len = 0;
+            }
+            word_start = i + 1;
+        } else if (isalpha(c)) {
+            char lower = tolower(c);
+            if (word_len < sizeof(current_word)) {
+                current_word[word_len] = lower;
+            } else {
+                if (word_len == sizeof(current_word)) long_word.assign(current_word, word_len);
+                long_word += lower;
+            }
+            word_len++;
+        }
+    }
+    *owned_tokens = owned;
+    return tokens;
+}
+
+// Texto dos tokens, para comparar versões com vocabulários distintos
+static string token_text(const vector<uint32_t>& tokens, const Vocabulary& vocab) {
+    string out;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        out.append(vocab.data(tokens[i]), vocab.length(tokens[i]));
+        out += ' ';
+    }
+    return out;
+}
+
+// Versão -1 é a referência
+static vector<uint32_t> run(int kind, string_view text, Vocabulary& vocab, size_t owned_chars, size_t* owned) {
+    if (kind < 0) return tokenize_reference(text, vocab, owned_chars, owned);
+    return tokenize_optimized(text, vocab, (TokenizerKind)kind, NORM_ASCII, owned_chars, owned);
+}
+
+static bool check(const string& text, int kind) {
+    // Cortes em posições variadas: início, meio de palavra, separador, fim
+    size_t cuts[] = { 0, 1, text.length() / 3, text.length() / 2 + 7, text.length() - 1, text.length() };
+    for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); c++) {
+        // Também desalinhado, para exercitar os finais de bloco
+        for (size_t skew = 0; skew < 3 && skew < text.length(); skew++) {
+            string_view view = string_view(text).substr(skew);
+            size_t owned_chars = cuts[c] > skew ? cuts[c] - skew : 0;
+            Vocabulary vr, vk;
+            size_t owned_r, owned_k;
+            vector<uint32_t> ref = run(-1, view, vr, owned_chars, &owned_r);
+            vector<uint32_t> got = run(kind, view, vk, owned_chars, &owned_k);
+            if (owned_r != owned_k || token_text(ref, vr) != token_text(got, vk)) return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Uso: " << argv[0] << " arquivo..." << endl;
+        return 1;
+    }
+    TokenizerKind best = best_tokenizer();
+    cout << "Melhor versão nesta CPU: " << tokenizer_name(best) << "\n";
+
+    for (int a = 1; a < argc; a++) {
+        ifstream file(argv[a], ios::binary);
+        if (!file.is_open()) {
+            cerr << "Erro ao abrir arquivo: " << argv[a] << endl;
+            return 1;
+        }
+        string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        cout << "\n" << argv[a] << " (" << text.length() << " bytes)\n";
+
+        for (int kind = -1; kind <= (int)best; kind++) {
+            if (kind >= 0 && !check(text, kind)) {
+                cout << tokenizer_name((TokenizerKind)kind) << ": tokens DIFERENTES da referência\n";
+                return 1;
+            }
+            double best_time = 1e30;
+            size_t num_tokens = 0, owned;
+            for (int r = 0; r < REPEATS; r++) {
+                Vocabulary vocab;
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                num_tokens = run(kind, text, vocab, string::npos, &owned).size();
+                best_time = min(best_time, seconds_since(start));
+            }
+            cout << "  " << (kind < 0 ? "referência" : tokenizer_name((TokenizerKind)kind))
+                 << ": " << best_time * 1000 << " ms, " << text.length() / best_time / 1e9 << " GB/s ("
+                 << num_tokens << " tokens)\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,428 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "normalize.h"
+#include "output.h"
+
+/**
+ * Configuração de execução do parallel, lida da linha de comando
+ * (getopt_long) e, opcionalmente, de arquivos de configuração.
+ *
+ * Um arquivo de configuração (--config ARQUIVO) tem uma opção por linha, com
+ * o mesmo nome da opção longa, sem os "--":
+ *
+ *   # comentário
+ *   n = 1-6
+ *   threshold = 3
+ *   input = textos/
+ *   reduce = shuffle
+ *   prefilter = 1
+ *
+ * As opções são aplicadas na ordem em que aparecem, então o que vem depois
+ * de --config sobrescreve o arquivo.
+ */
+
+enum ReadMode { READ_TREE, READ_RANGES, READ_BLOCKS };
+enum ReductionMode { REDUCE_TREE, REDUCE_SHUFFLE, REDUCE_SKETCH, REDUCE_NODE };
+enum CountEngine { ENGINE_HASH, ENGINE_SORT };
+
+const int MAX_THREADS = 1024; // Limite de --threads
+
+// Limites do --reduce sketch, para que os resumos caibam na memória: o
+// Count-Min tem ln(1/delta) linhas de e/epsilon contadores (até 28 linhas de
+// 16 MB) e o Space-Saving, 24 bytes por entrada
+const double MIN_SKETCH_EPSILON = 1e-6;
+const double MIN_SKETCH_DELTA = 1e-12;
+const int MAX_SKETCH_TOP_K = 10000000;
+
+struct Config {
+    std::vector<int> ns;              // Tamanhos de n-grama, contados numa só passada
+    int min_threshold;                // Limiar mínimo para exibir
+    std::vector<std::string> inputs;  // Arquivos de entrada (diretórios já expandidos)
+
+    int read_mode;                    // Como o texto chega a cada processo (ReadMode)
+    int reduction;                    // Como as contagens locais são combinadas (ReductionMode)
+    bool prefilter;                   // Filtro de limiar exato antes de REDUCE_TREE/REDUCE_SHUFFLE/REDUCE_NODE
+
+    double sketch_epsilon;            // Parâmetros de REDUCE_SKETCH (ver sketch.h)
+    double sketch_delta;
+    int sketch_top_k;
+    bool sketch_verify;
+
+    int normalization;                // O que conta como letra (ver normalize.h)
+    size_t char_threshold;            // Abaixo disso um nó da árvore conquista em vez de dividir
+    size_t block_chars;               // Tamanho dos blocos de READ_BLOCKS
+    bool use_mmap;                    // Entrada mapeada em memória (ver mapped_file.h); senão read()/MPI-IO
+
+    int engine;                       // Como cada bloco é contado (CountEngine)
+    int threads;                      // Threads por processo
+    size_t memory_bytes;              // Orçamento de memória por processo (0: sem limite)
+    std::string spill_dir;            // Onde gravar as runs quando há orçamento
+
+    bool debug;                       // Mensagens de cada processo
+    bool print_ngrams;                // Imprime os n-gramas significativos
+    int order;                        // Ordem dos resultados (ResultOrder, ver output.h)
+    size_t top_k;                     // Só os top_k mais frequentes (0: todos)
+    std::string output_path;          // Grava os resultados em arquivo (vazio: não grava)
+    int output_format;                // ResultFormat dos arquivos
+    bool output_shared;               // Um arquivo só, via MPI-IO, em vez de uma parte por processo
+    std::string snapshot_dir;         // Snapshot persistente das contagens (vazio: nenhum; ver snapshot.h)
+    bool update;                      // Soma as entradas novas ao snapshot em vez de criar outro
+    bool compact;                     // Junta as camadas do snapshot numa só
+    bool stats;                       // Tabela de tempos e contadores por processo (ver instrument.h)
+    std::string trace_path;           // Linha do tempo no formato do Chrome trace (vazio: não grava)
+
+    Config()
+        : ns(1, 5), min_threshold(2), read_mode(READ_TREE), reduction(REDUCE_TREE), prefilter(false),
+          sketch_epsilon(1e-4), sketch_delta(0.01), sketch_top_k(1000), sketch_verify(true),
+          normalization(NORM_UTF8), char_threshold(100000), block_chars(1 << 20), use_mmap(true), engine(ENGINE_HASH), threads(1),
+          memory_bytes(0), spill_dir("/tmp"), debug(false), print_ngrams(false), order(ORDER_NONE), top_k(0), output_format(FORMAT_TSV),
+          output_shared(false), update(false), compact(false), stats(false) {}
+
+    int max_n() const { return *std::max_element(ns.begin(), ns.end()); }
+};
+
+inline const char* read_mode_name(int mode) {
+    switch (mode) {
+        case READ_RANGES: return "MPI-IO por processo";
+        case READ_BLOCKS: return "blocos dinâmicos com MPI-IO";
+        default: return "Rank 0 + distribuição";
+    }
+}
+
+// Inteiro decimal sem sinal em [lo, hi], sem sobras depois dos dígitos
+inline bool parseUnsigned(const std::string& value, unsigned long long lo, unsigned long long hi,
+                          unsigned long long& out) {
+    if (value.empty() || !isdigit((unsigned char)value[0])) return false; // strtoull aceitaria "-1"
+    char* end;
+    errno = 0;
+    out = strtoull(value.c_str(), &end, 10);
+    return errno == 0 && *end == '\0' && out >= lo && out <= hi;
+}
+
+// Número real em [lo, hi] (strtod), sem sobras depois dele
+inline bool parseDouble(const std::string& value, double lo, double hi, double& out) {
+    if (value.empty() || isspace((unsigned char)value[0])) return false;
+    char* end;
+    errno = 0;
+    out = strtod(value.c_str(), &end);
+    return errno == 0 && *end == '\0' && out >= lo && out <= hi;
+}
+
+// Lista de N: "5", "1-6" ou "2,3,5" (e combinações como "1-3,5")
+inline bool parseNList(const std::string& text, std::vector<int>& ns) {
+    std::vector<int> parsed;
+    size_t start = 0;
+    while (start <= text.length()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.length();
+        std::string item = text.substr(start, comma - start);
+        size_t dash = item.find('-');
+        unsigned long long lo, hi;
+        // N vai num byte do formato de ngram_wire.h
+        if (!parseUnsigned(item.substr(0, dash), 1, 255, lo)) return false;
+        if (dash == std::string::npos) hi = lo;
+        else if (!parseUnsigned(item.substr(dash + 1), lo, 255, hi)) return false;
+        for (int n = (int)lo; n <= (int)hi; n++) {
+            if (std::find(parsed.begin(), parsed.end(), n) == parsed.end()) parsed.push_back(n);
+        }
+        start = comma + 1;
+    }
+    if (parsed.empty()) return false;
+    ns = parsed;
+    return true;
+}
+
+inline bool parseBool(const std::string& value, bool& out) {
+    if (value == "1" || value == "yes" || value == "true" || value == "sim") return out = true, true;
+    if (value == "0" || value == "no" || value == "false" || value == "nao" || value == "não") return out = false, true;
+    return false;
+}
+
+inline bool loadConfigFile(const std::string& path, Config& config, std::string& error);
+
+/**
+ * Aplica uma opção (pelo nome longo, sem "--"). Usada tanto pela linha de
+ * comando quanto pelos arquivos de configuração.
+ */
+inline bool setOption(Config& config, const std::string& name, const std::string& value, std::string& error) {
+    bool ok = true;
+    unsigned long long number;
+    if (name == "n") {
+        ok = parseNList(value, config.ns);
+    } else if (name == "threshold") {
+        ok = parseUnsigned(value, 1, INT_MAX, number);
+        if (ok) config.min_threshold = (int)number;
+    } else if (name == "input") {
+        config.inputs.push_back(value);
+    } else if (name == "read") {
+        if (value == "tree") config.read_mode = READ_TREE;
+        else if (value == "ranges") config.read_mode = READ_RANGES;
+        else if (value == "blocks") config.read_mode = READ_BLOCKS;
+        else ok = false;
+    } else if (name == "reduce") {
+        if (value == "tree") config.reduction = REDUCE_TREE;
+        else if (value == "shuffle") config.reduction = REDUCE_SHUFFLE;
+        else if (value == "sketch") config.reduction = REDUCE_SKETCH;
+        else if (value == "node") config.reduction = REDUCE_NODE;
+        else ok = false;
+    } else if (name == "prefilter") {
+        ok = parseBool(value, config.prefilter);
+    } else if (name == "sketch-epsilon") {
+        ok = parseDouble(value, MIN_SKETCH_EPSILON, 1, config.sketch_epsilon) && config.sketch_epsilon < 1;
+    } else if (name == "sketch-delta") {
+        ok = parseDouble(value, MIN_SKETCH_DELTA, 1, config.sketch_delta) && config.sketch_delta < 1;
+    } else if (name == "sketch-top-k") {
+        ok = parseUnsigned(value, 1, MAX_SKETCH_TOP_K, number);
+        if (ok) config.sketch_top_k = (int)number;
+    } else if (name == "sketch-verify") {
+        ok = parseBool(value, config.sketch_verify);
+    } else if (name == "normalize") {
+        if (value == "ascii") config.normalization = NORM_ASCII;
+        else if (value == "utf8") config.normalization = NORM_UTF8;
+        else if (value == "strip") config.normalization = NORM_UTF8_STRIP;
+        else ok = false;
+    } else if (name == "char-threshold") {
+        ok = parseUnsigned(value, 0, SIZE_MAX, number);
+        if (ok) config.char_threshold = number;
+    } else if (name == "block-size") {
+        ok = parseUnsigned(value, 1, SIZE_MAX, number);
+        if (ok) config.block_chars = number;
+    } else if (name == "mmap") {
+        ok = parseBool(value, config.use_mmap);
+    } else if (name == "engine") {
+        if (value == "hash") config.engine = ENGINE_HASH;
+        else if (value == "sort") config.engine = ENGINE_SORT;
+        else ok = false;
+    } else if (name == "threads") {
+        ok = parseUnsigned(value, 1, MAX_THREADS, number);
+        if (ok) config.threads = (int)number;
+    } else if (name == "memory") {
+        ok = parseUnsigned(value, 0, SIZE_MAX >> 20, number); // Em MiB
+        if (ok) config.memory_bytes = number << 20;
+    } else if (name == "spill-dir") {
+        config.spill_dir = value;
+    } else if (name == "debug") {
+        ok = parseBool(value, config.debug);
+    } else if (name == "print") {
+        ok = parseBool(value, config.print_ngrams);
+    } else if (name == "sort") {
+        if (value == "none") config.order = ORDER_NONE;
+        else if (value == "count") config.order = ORDER_COUNT;
+        else if (value == "ngram") config.order = ORDER_NGRAM;
+        else ok = false;
+    } else if (name == "top") {
+        ok = parseUnsigned(value, 0, SIZE_MAX, number);
+        if (ok) config.top_k = number;
+    } else if (name == "output") {
+        config.output_path = value;
+    } else if (name == "format") {
+        if (value == "text") config.output_format = FORMAT_TEXT;
+        else if (value == "tsv") config.output_format = FORMAT_TSV;
+        else if (value == "binary") config.output_format = FORMAT_BINARY;
+        else if (value == "lookup") config.output_format = FORMAT_LOOKUP;
+        else ok = false;
+    } else if (name == "output-mode") {
+        if (value == "parts") config.output_shared = false;
+        else if (value == "shared") config.output_shared = true;
+        else ok = false;
+    } else if (name == "snapshot") {
+        config.snapshot_dir = value;
+    } else if (name == "update") {
+        ok = parseBool(value, config.update);
+    } else if (name == "compact") {
+        ok = parseBool(value, config.compact);
+    } else if (name == "stats") {
+        ok = parseBool(value, config.stats);
+    } else if (name == "trace") {
+        config.trace_path = value;
+    } else if (name == "config") {
+        return loadConfigFile(value, config, error);
+    } else {
+        error = "opção desconhecida: " + name;
+        return false;
+    }
+    if (!ok) error = "valor inválido para " + name + ": " + value;
+    return ok;
+}
+
+inline std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+inline bool loadConfigFile(const std::string& path, Config& config, std::string& error) {
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        error = "erro ao abrir arquivo de configuração: " + path;
+        return false;
+    }
+    std::string line;
+    for (int line_number = 1; std::getline(file, line); line_number++) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        size_t eq = line.find('=');
+        std::string name = trim(line.substr(0, eq));
+        std::string value = (eq == std::string::npos) ? "1" : trim(line.substr(eq + 1));
+        if (!setOption(config, name, value, error)) {
+            error = path + ":" + std::to_string(line_number) + ": " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Troca cada diretório da lista pelos arquivos regulares dentro dele, em ordem alfabética
+inline bool expandInputs(std::vector<std::string>& inputs, std::string& error) {
+    std::vector<std::string> files;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        struct stat st;
+        if (stat(inputs[i].c_str(), &st) != 0) {
+            error = "entrada não encontrada: " + inputs[i];
+            return false;
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            files.push_back(inputs[i]);
+            continue;
+        }
+        DIR* dir = opendir(inputs[i].c_str());
+        if (!dir) {
+            error = "erro ao abrir diretório: " + inputs[i];
+            return false;
+        }
+        std::vector<std::string> entries;
+        while (struct dirent* entry = readdir(dir)) {
+            std::string path = inputs[i] + "/" + entry->d_name;
+            if (entry->d_name[0] != '.' && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                entries.push_back(path);
+            }
+        }
+        closedir(dir);
+        std::sort(entries.begin(), entries.end());
+        files.insert(files.end(), entries.begin(), entries.end());
+    }
+    inputs = files;
+    return true;
+}
+
+inline const char* usage() {
+    return "Uso: parallel [opções] [arquivo|diretório ...]\n"
+           "  -n, --n LISTA            tamanhos de n-grama, ex.: 5, 1-6, 2,3,5 (padrão 5)\n"
+           "  -t, --threshold T        limiar mínimo para exibir (padrão 2)\n"
+           "  -i, --input CAMINHO      arquivo ou diretório de entrada (pode repetir; padrão big_bible.txt)\n"
+           "  -c, --config ARQUIVO     lê opções de um arquivo (\"nome = valor\" por linha)\n"
+           "      --read MODO          tree | ranges | blocks (padrão tree)\n"
+           "      --reduce MODO        tree | shuffle | sketch | node (padrão tree)\n"
+           "      --prefilter          filtro de limiar exato antes da redução\n"
+           "      --sketch-epsilon E   erro do Count-Min (padrão 0.0001)\n"
+           "      --sketch-delta D     1 - confiança do Count-Min (padrão 0.01)\n"
+           "      --sketch-top-k K     tamanho do resumo Space-Saving (padrão 1000)\n"
+           "      --sketch-verify 0|1  contagens exatas dos candidatos (padrão 1)\n"
+           "      --normalize MODO     ascii | utf8 | strip (padrão utf8)\n"
+           "      --char-threshold B   tamanho abaixo do qual um nó da árvore conquista (padrão 100000)\n"
+           "      --block-size B       tamanho dos blocos de --read blocks (padrão 1048576)\n"
+           "      --mmap 0|1           lê a entrada com mmap, ou com read()/MPI-IO (padrão 1)\n"
+           "      --engine MODO        hash | sort: contagem de cada bloco (padrão hash)\n"
+           "      --threads T          threads por processo (padrão 1)\n"
+           "      --memory MB          orçamento de memória por processo, com runs em disco\n"
+           "      --spill-dir DIR      diretório das runs (padrão /tmp)\n"
+           "  -p, --print              imprime os n-gramas significativos\n"
+           "      --sort ORDEM         none | count | ngram: ordem da saída, com ordenação distribuída (padrão none)\n"
+           "      --top K              só os K mais frequentes, em ordem de contagem\n"
+           "  -o, --output CAMINHO     grava os n-gramas significativos em arquivo(s)\n"
+           "      --format FORMATO     text | tsv | binary | lookup, para --output (padrão tsv);\n"
+           "                           lookup: arquivo de consulta do programa query, em ordem de n-grama\n"
+           "      --output-mode MODO   parts (CAMINHO.part-RRRRR por processo) | shared (um arquivo, MPI-IO)\n"
+           "      --snapshot DIR       grava as contagens num snapshot persistente em DIR\n"
+           "      --update             conta só as entradas novas e as soma ao snapshot de --snapshot\n"
+           "      --compact            junta as camadas do snapshot numa só\n"
+           "  -d, --debug              mensagens de cada processo\n"
+           "  -s, --stats              tempos por fase, bytes, mensagens e memória (mín/média/máx entre processos)\n"
+           "      --trace ARQUIVO      grava a linha do tempo das fases de cada processo (Chrome trace)\n"
+           "  -h, --help               esta ajuda\n";
+}
+
+/**
+ * Lê a linha de comando. Devolve false com a mensagem em `error` se alguma
+ * opção for inválida; `help` indica que --help foi pedido.
+ */
+inline bool parseCommandLine(int argc, char** argv, Config& config, bool& help, std::string& error) {
+    static const struct option options[] = {
+        { "n", required_argument, NULL, 'n' },
+        { "threshold", required_argument, NULL, 't' },
+        { "input", required_argument, NULL, 'i' },
+        { "config", required_argument, NULL, 'c' },
+        { "read", required_argument, NULL, 0 },
+        { "reduce", required_argument, NULL, 0 },
+        { "prefilter", no_argument, NULL, 0 },
+        { "sketch-epsilon", required_argument, NULL, 0 },
+        { "sketch-delta", required_argument, NULL, 0 },
+        { "sketch-top-k", required_argument, NULL, 0 },
+        { "sketch-verify", required_argument, NULL, 0 },
+        { "normalize", required_argument, NULL, 0 },
+        { "char-threshold", required_argument, NULL, 0 },
+        { "block-size", required_argument, NULL, 0 },
+        { "mmap", required_argument, NULL, 0 },
+        { "engine", required_argument, NULL, 0 },
+        { "threads", required_argument, NULL, 0 },
+        { "memory", required_argument, NULL, 0 },
+        { "spill-dir", required_argument, NULL, 0 },
+        { "print", no_argument, NULL, 'p' },
+        { "sort", required_argument, NULL, 0 },
+        { "top", required_argument, NULL, 0 },
+        { "output", required_argument, NULL, 'o' },
+        { "format", required_argument, NULL, 0 },
+        { "output-mode", required_argument, NULL, 0 },
+        { "snapshot", required_argument, NULL, 0 },
+        { "update", no_argument, NULL, 0 },
+        { "compact", no_argument, NULL, 0 },
+        { "debug", no_argument, NULL, 'd' },
+        { "stats", no_argument, NULL, 's' },
+        { "trace", required_argument, NULL, 0 },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    help = false;
+    opterr = 0; // As mensagens de erro saem por `error`, só do Rank 0
+    int c, index;
+    while ((c = getopt_long(argc, argv, "n:t:i:c:po:dsh", options, &index)) != -1) {
+        std::string name;
+        switch (c) {
+            case 0: name = options[index].name; break;
+            case 'n': name = "n"; break;
+            case 't': name = "threshold"; break;
+            case 'i': name = "input"; break;
+            case 'c': name = "config"; break;
+            case 'p': name = "print"; break;
+            case 'o': name = "output"; break;
+            case 'd': name = "debug"; break;
+            case 's': name = "stats"; break;
+            case 'h': help = true; return true;
+            default:
+                error = std::string("opção inválida ou sem valor: ") + argv[optind - 1];
+                return false;
+        }
+        std::string value = optarg ? optarg : "1";
+        if (!setOption(config, name, value, error)) return false;
+    }
+    for (int i = optind; i < argc; i++) config.inputs.push_back(argv[i]);
+    // Uma atualização do snapshot pode não ter entradas novas
+    if (config.inputs.empty() && !config.update && !config.compact) config.inputs.push_back("big_bible.txt");
+    return expandInputs(config.inputs, error);
+}
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ngram_table.h"
+
+/**
+ * Instrumentação por processo (--stats e --trace): tempo gasto em cada fase,
+ * contadores de bytes e mensagens, estatísticas das tabelas e pico de
+ * memória. Desligada, cada PhaseTimer custa um teste de booleano; ligada,
+ * duas leituras do relógio por trecho medido, e os trechos são grandes
+ * (um bloco de texto, uma mensagem), nunca um token.
+ *
+ * O tempo de uma fase é somado entre as threads do processo, então com
+ * --threads T a tokenização e a contagem podem passar do tempo de parede.
+ * A redução entre processos (mínimo, média e máximo) é feita em parallel.cpp.
+ */
+
+enum Phase {
+    PH_READ,           // Leitura do arquivo (ou das runs em disco)
+    PH_TOKENIZE,
+    PH_COUNT,          // Inserção dos n-gramas nas tabelas
+    PH_LOCAL_MERGE,    // Junção das tabelas das threads
+    PH_SERIALIZE,
+    PH_SEND,           // Envios ponto a ponto, até completarem
+    PH_RECEIVE,        // Espera por mensagens ponto a ponto
+    PH_RECEIVED_MERGE, // Desserialização e soma do que chegou
+    PH_NODE_MERGE,     // Soma na tabela compartilhada do nó (--reduce node)
+    PH_COLLECTIVE,     // Alltoallv, Allreduce, Gather, barreiras e o contador de blocos
+    PH_SKETCH,         // Construção e consulta dos resumos (sketch e filtro)
+    PH_SPILL,          // Gravação das runs
+    PH_OUTPUT,         // Seleção, ordenação, impressão e gravação dos resultados
+    NUM_PHASES
+};
+
+enum Counter {
+    CT_BYTES_READ,
+    CT_TOKENS,
+    CT_MESSAGES_SENT,
+    CT_BYTES_SENT,
+    CT_MESSAGES_RECEIVED,
+    CT_BYTES_RECEIVED,
+    CT_BYTES_SPILLED,
+    NUM_COUNTERS
+};
+
+// Medidas pontuais, registradas uma vez (ao fim da contagem local)
+enum Gauge {
+    GA_TABLE_ENTRIES,  // Entradas das tabelas locais, somadas entre os N
+    GA_LOAD_FACTOR,    // Da maior tabela
+    GA_MEAN_PROBE,     // Distância média à posição ideal (Robin Hood), de todas as tabelas
+    GA_MAX_PROBE,
+    GA_VOCAB_WORDS,
+    GA_PEAK_RSS_MB,    // Preenchida em values()
+    NUM_GAUGES
+};
+
+inline const char* phase_name(int p) {
+    static const char* names[NUM_PHASES] = {
+        "leitura", "tokenização", "contagem", "merge local", "serialização", "envio",
+        "recepção", "merge recebido", "merge no nó", "coletivas", "resumos", "spill", "saída"
+    };
+    return names[p];
+}
+
+inline const char* counter_name(int c) {
+    static const char* names[NUM_COUNTERS] = {
+        "bytes lidos", "tokens", "mensagens enviadas", "bytes enviados",
+        "mensagens recebidas", "bytes recebidos", "bytes em runs"
+    };
+    return names[c];
+}
+
+inline const char* gauge_name(int g) {
+    static const char* names[NUM_GAUGES] = {
+        "entradas locais", "fator de carga", "sondagem média", "sondagem máxima",
+        "palavras no vocabulário", "pico de RSS (MB)"
+    };
+    return names[g];
+}
+
+class Profile {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profile() : on(false), tracing(false) {
+        for (int p = 0; p < NUM_PHASES; p++) phase_ns[p] = 0;
+        for (int c = 0; c < NUM_COUNTERS; c++) counters[c] = 0;
+        for (int g = 0; g < NUM_GAUGES; g++) gauges[g] = 0;
+    }
+
+    // Liga a instrumentação; os instantes do trace contam a partir daqui
+    void start(bool with_trace) {
+        on = true;
+        tracing = with_trace;
+        origin = Clock::now();
+    }
+
+    bool enabled() const { return on; }
+
+    // Número da thread no WorkStealingPool, para o tid do trace (0 fora dele)
+    static void set_thread(int t) { thread_index() = t; }
+
+    void add_time(Phase phase, Clock::time_point begin, Clock::time_point end) {
+        phase_ns[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        if (!tracing) return;
+        TraceEvent ev;
+        ev.phase = phase;
+        ev.thread = thread_index();
+        ev.start_us = std::chrono::duration<double, std::micro>(begin - origin).count();
+        ev.dur_us = std::chrono::duration<double, std::micro>(end - begin).count();
+        std::lock_guard<std::mutex> guard(trace_lock);
+        events.push_back(ev);
+    }
+
+    void count(Counter c, uint64_t value) {
+        if (on) counters[c] += value;
+    }
+
+    // Estatísticas das tabelas de um conjunto, logo depois da contagem local
+    void record_tables(const NgramCountSet& counts) {
+        if (!on) return;
+        double entries = 0, probe_sum = 0, load = 0, max_probe = 0;
+        size_t largest = 0;
+        for (size_t i = 0; i < counts.tables.size(); i++) {
+            const NgramTable& table = counts.tables[i];
+            double mean;
+            size_t max;
+            table.probe_lengths(mean, max);
+            entries += table.size();
+            probe_sum += mean * table.size();
+            max_probe = std::max(max_probe, (double)max);
+            if (table.size() >= largest) largest = table.size(), load = table.load_factor();
+        }
+        gauges[GA_TABLE_ENTRIES] = entries;
+        gauges[GA_LOAD_FACTOR] = load;
+        gauges[GA_MEAN_PROBE] = entries > 0 ? probe_sum / entries : 0;
+        gauges[GA_MAX_PROBE] = max_probe;
+        gauges[GA_VOCAB_WORDS] = counts.vocab.size();
+    }
+
+    static int num_values() { return NUM_PHASES + NUM_COUNTERS + NUM_GAUGES; }
+
+    // Fases (em segundos), contadores e medidas num só vetor, para a redução entre processos
+    std::vector<double> values() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        gauges[GA_PEAK_RSS_MB] = usage.ru_maxrss / 1024.0;
+
+        std::vector<double> v;
+        for (int p = 0; p < NUM_PHASES; p++) v.push_back(phase_ns[p] / 1e9);
+        for (int c = 0; c < NUM_COUNTERS; c++) v.push_back((double)counters[c]);
+        for (int g = 0; g < NUM_GAUGES; g++) v.push_back(gauges[g]);
+        return v;
+    }
+
+    static std::string value_name(int i) {
+        if (i < NUM_PHASES) return std::string(phase_name(i)) + " (s)";
+        if (i < NUM_PHASES + NUM_COUNTERS) return counter_name(i - NUM_PHASES);
+        return gauge_name(i - NUM_PHASES - NUM_COUNTERS);
+    }
+
+    /**
+     * Eventos deste processo no formato do Chrome trace (chrome://tracing,
+     * Perfetto), separados por vírgula, sem os colchetes: pid é o rank e
+     * tid a thread.
+     */
+    std::string trace_events(int rank) {
+        std::lock_guard<std::mutex> guard(trace_lock);
+        std::string out;
+        char line[256];
+        snprintf(line, sizeof(line), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Rank %d\"}}",
+                 rank, rank);
+        out += line;
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEvent& ev = events[i];
+            snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     phase_name(ev.phase), rank, ev.thread, ev.start_us, ev.dur_us);
+            out += line;
+        }
+        return out;
+    }
+
+private:
+    struct TraceEvent {
+        int phase;
+        int thread;
+        double start_us;
+        double dur_us;
+    };
+
+    static int& thread_index() {
+        thread_local int index = 0;
+        return index;
+    }
+
+    bool on;
+    bool tracing;
+    Clock::time_point origin;
+    std::atomic<uint64_t> phase_ns[NUM_PHASES];
+    std::atomic<uint64_t> counters[NUM_COUNTERS];
+    double gauges[NUM_GAUGES];
+    std::mutex trace_lock;
+    std::vector<TraceEvent> events;
+};
+
+// A instrumentação do processo
+inline Profile profile;
+
+/**
+ * Mede o trecho entre a construção e a destruição (ou stop()) como tempo da
+ * fase. Não faz nada se a instrumentação estiver desligada.
+ */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase), running(profile.enabled()) {
+        if (running) begin = Profile::Clock::now();
+    }
+    ~PhaseTimer() { stop(); }
+
+    void stop() {
+        if (!running) return;
+        running = false;
+        profile.add_time(phase, begin, Profile::Clock::now());
+    }
+
+    // Começa um novo trecho da mesma fase
+    void restart() {
+        stop();
+        running = profile.enabled();
+        if (running) begin = Profile::Clock::now();
+    }
+
+private:
+    Phase phase;
+    bool running;
+    Profile::Clock::time_point begin;
+};
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef LOOKUP_H
+#define LOOKUP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "mapped_file.h"
+#include "normalize.h"
+
+/**
+ * Arquivo de consulta (--format lookup): os n-gramas de um N e as suas
+ * contagens num arquivo imutável, feito para ser mapeado em memória e
+ * consultado direto, sem etapa de carga.
+ *
+ *   cabeçalho (64 bytes, LookupHeader)
+ *   contagens: u32[count]
+ *   offsets:   u64[count + 1], início de cada n-grama na arena (o último é
+ *              o tamanho da arena)
+ *   arena:     os textos "w1 w2 ... wN", em ordem de bytes (memcmp), sem
+ *              separadores
+ *
+ * As seções começam em múltiplos de 8 bytes. Como os textos estão
+ * ordenados, os n-gramas que começam com as mesmas palavras ficam numa faixa
+ * contígua: uma busca binária acha um n-grama e também todos os que
+ * estendem um (N-1)-grama (ou qualquer prefixo de palavras).
+ */
+
+const char LOOKUP_MAGIC[4] = { 'N', 'G', 'L', 'K' };
+const uint32_t LOOKUP_VERSION = 1;
+
+struct LookupHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t n;
+    uint32_t normalization;     // Modo de normalize.h com que os n-gramas foram contados
+    uint64_t count;             // Número de n-gramas
+    uint64_t total;             // Total de n-gramas contados (para as frequências)
+    uint64_t counts_offset;
+    uint64_t offsets_offset;
+    uint64_t arena_offset;
+    uint64_t arena_size;
+};
+
+inline uint64_t lookup_align(uint64_t offset) { return (offset + 7) & ~(uint64_t)7; }
+
+// Cabeçalho de um arquivo com `count` n-gramas e `arena_size` bytes de texto
+inline LookupHeader lookup_header(int N, int normalization, uint64_t count, uint64_t total, uint64_t arena_size) {
+    LookupHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LOOKUP_MAGIC, 4);
+    h.version = LOOKUP_VERSION;
+    h.n = N;
+    h.normalization = normalization;
+    h.count = count;
+    h.total = total;
+    h.counts_offset = sizeof(LookupHeader);
+    h.offsets_offset = lookup_align(h.counts_offset + count * sizeof(uint32_t));
+    h.arena_offset = h.offsets_offset + (count + 1) * sizeof(uint64_t);
+    h.arena_size = arena_size;
+    return h;
+}
+
+/**
+ * Leitura de um arquivo de consulta mapeado em memória. open() só confere o
+ * cabeçalho; as páginas são lidas sob demanda pelas buscas.
+ */
+class NgramLookup {
+public:
+    NgramLookup() : header(NULL), counts(NULL), offsets(NULL), arena(NULL) { file.kind = MAPPED_NONE; }
+    ~NgramLookup() { mapped_file_close(&file); }
+
+    bool open(const std::string& path, std::string& error) {
+        mapped_file_close(&file);
+        if (mapped_file_open(&file, path.c_str(), 1) != 0) {
+            error = "erro ao abrir " + path + ": " + strerror(errno);
+            return false;
+        }
+        header = (const LookupHeader*)file.data;
+        if (file.size < sizeof(LookupHeader) || memcmp(header->magic, LOOKUP_MAGIC, 4) != 0 ||
+            header->version != LOOKUP_VERSION) {
+            error = "não é um arquivo de consulta: " + path;
+            return false;
+        }
+        // Cada n-grama ocupa ao menos 12 bytes (contagem e offset): limitar
+        // count pelo tamanho do arquivo evita overflow nas contas das seções
+        bool valid = header->counts_offset == sizeof(LookupHeader) &&
+                     header->count <= (file.size - sizeof(LookupHeader)) / (sizeof(uint32_t) + sizeof(uint64_t));
+        if (valid) {
+            LookupHeader expected = lookup_header(header->n, header->normalization, header->count, header->total,
+                                                  header->arena_size);
+            valid = header->offsets_offset == expected.offsets_offset && header->arena_offset == expected.arena_offset &&
+                    header->arena_offset <= file.size && header->arena_size <= file.size - header->arena_offset;
+        }
+        if (!valid) {
+            error = "arquivo de consulta truncado ou inválido: " + path;
+            return false;
+        }
+        counts = (const uint32_t*)(file.data + header->counts_offset);
+        offsets = (const uint64_t*)(file.data + header->offsets_offset);
+        arena = file.data + header->arena_offset;
+        if (offsets[header->count] != header->arena_size) {
+            error = "arquivo de consulta truncado ou inválido: " + path;
+            return false;
+        }
+        // Buscas binárias saltam pelo arquivo: leitura antecipada não ajuda
+        mapped_file_advise(&file, 0, file.size, MADV_RANDOM);
+        return true;
+    }
+
+    size_t size() const { return header->count; }
+    int n() const { return header->n; }
+    int normalization() const { return header->normalization; }
+    uint64_t total() const { return header->total; }
+
+    // Os offsets não são conferidos no open(), para não ler o arquivo inteiro;
+    // um par fora da arena (arquivo corrompido) vira uma chave vazia
+    std::string_view key(size_t i) const {
+        uint64_t begin = offsets[i], end = offsets[i + 1];
+        if (begin > end || end > header->arena_size) return std::string_view();
+        return std::string_view(arena + begin, end - begin);
+    }
+    uint32_t count(size_t i) const { return counts[i]; }
+
+    // Primeiro índice cuja chave não é menor que `text`
+    size_t lower_bound(std::string_view text) const {
+        size_t lo = 0, hi = size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (key(mid) < text) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Contagem do n-grama (já normalizado, palavras separadas por um espaço); 0 se não está no arquivo
+    uint32_t find(std::string_view ngram) const {
+        size_t i = lower_bound(ngram);
+        return (i < size() && key(i) == ngram) ? count(i) : 0;
+    }
+
+    /**
+     * Faixa [first, last) dos n-gramas cujas primeiras palavras são as de
+     * `words` (1 a N-1 palavras normalizadas, separadas por um espaço).
+     */
+    std::pair<size_t, size_t> prefix_range(std::string_view words) const {
+        std::string prefix(words);
+        prefix += ' ';
+        size_t first = lower_bound(prefix);
+        // Depois do último n-grama com o prefixo vem o primeiro maior que "prefixo" + 0xFF...
+        prefix[prefix.length() - 1] = ' ' + 1;
+        return std::make_pair(first, lower_bound(prefix));
+    }
+
+private:
+    NgramLookup(const NgramLookup&);
+    NgramLookup& operator=(const NgramLookup&);
+
+    MappedFile file;
+    const LookupHeader* header;
+    const uint32_t* counts;
+    const uint64_t* offsets;
+    const char* arena;
+};
+
+/**
+ * Normaliza uma consulta como o texto foi normalizado na contagem: palavras
+ * separadas por espaços, tabulações ou quebras de linha, cada uma com
+ * norm_word; as que ficam vazias são descartadas.
+ */
+inline std::string normalize_query(std::string_view query, int normalization) {
+    std::string out, word;
+    size_t i = 0;
+    while (i < query.length()) {
+        while (i < query.length() && (query[i] == ' ' || query[i] == '\t' || query[i] == '\n' || query[i] == '\r')) i++;
+        size_t start = i;
+        while (i < query.length() && !(query[i] == ' ' || query[i] == '\t' || query[i] == '\n' || query[i] == '\r')) i++;
+        if (i == start) continue;
+        word.resize(2 * (i - start));
+        word.resize(norm_word(query.data() + start, i - start, normalization, &word[0]));
+        if (word.empty()) continue;
+        if (!out.empty()) out += ' ';
+        out += word;
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+/*
+ * Entrada comum ao ngrams.c e ao parallel.cpp (C e C++): o arquivo inteiro
+ * como um bloco de memória somente leitura, sem cópia.
+ *
+ * O caminho normal é mmap: os tokenizadores trabalham direto sobre as
+ * páginas do page cache, e o processo só ocupa as páginas que de fato lê
+ * (que o kernel pode descartar, por serem do arquivo). madvise indica a
+ * leitura sequencial (MADV_SEQUENTIAL, leitura antecipada maior) e os
+ * trechos que vão ser lidos em seguida (MADV_WILLNEED).
+ *
+ * Quando o mmap não é possível (pipe, /proc, sistema de arquivos sem
+ * suporte) ou foi desligado, o arquivo é lido com read() em blocos para um
+ * buffer alocado, numa única cópia.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum { MAPPED_NONE = 0, MAPPED_MMAP = 1, MAPPED_BUFFER = 2 };
+
+typedef struct {
+    const char *data;   /* Conteúdo do arquivo (não termina em '\0') */
+    size_t size;
+    int kind;           /* MAPPED_MMAP, MAPPED_BUFFER, ou MAPPED_NONE se vazio */
+} MappedFile;
+
+/* Tamanho dos blocos do read() quando o tamanho do arquivo é desconhecido */
+#define MAPPED_READ_CHUNK (1 << 20)
+
+/* Mapeia o arquivo inteiro; devolve 0, ou -1 com errno se o mmap não deu certo */
+static inline int mapped_file_map(MappedFile *f, const char *path) {
+    f->data = NULL;
+    f->size = 0;
+    f->kind = MAPPED_NONE;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    int stat_ok = fstat(fd, &st) == 0;
+    if (!stat_ok || !S_ISREG(st.st_mode)) {
+        int saved = stat_ok ? ENODEV : errno; /* Não é arquivo regular: não dá para mapear */
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    if (st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+        f->data = (const char *)p;
+        f->size = (size_t)st.st_size;
+        f->kind = MAPPED_MMAP;
+    }
+    close(fd); /* O mapeamento continua válido sem o descritor */
+    return 0;
+}
+
+/* Lê o arquivo inteiro com read() para um buffer; devolve 0, ou -1 com errno */
+static inline int mapped_file_read(MappedFile *f, const char *path) {
+    f->data = NULL;
+    f->size = 0;
+    f->kind = MAPPED_NONE;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    size_t capacity = MAPPED_READ_CHUNK;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) capacity = (size_t)st.st_size + 1;
+
+    char *buf = (char *)malloc(capacity);
+    size_t len = 0;
+    while (buf) {
+        if (len == capacity) {
+            char *grown = (char *)realloc(buf, capacity * 2);
+            if (!grown) break;
+            buf = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, buf + len, capacity - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            int saved = errno;
+            close(fd);
+            if (n < 0) {
+                free(buf);
+                errno = saved;
+                return -1;
+            }
+            f->data = buf;
+            f->size = len;
+            f->kind = MAPPED_BUFFER;
+            return 0;
+        }
+        len += (size_t)n;
+    }
+    free(buf);
+    close(fd);
+    errno = ENOMEM;
+    return -1;
+}
+
+/* mmap se use_mmap e se possível; senão read(). Devolve 0, ou -1 com errno */
+static inline int mapped_file_open(MappedFile *f, const char *path, int use_mmap) {
+    if (use_mmap && mapped_file_map(f, path) == 0) return 0;
+    return mapped_file_read(f, path);
+}
+
+/*
+ * madvise sobre [offset, offset + len) do arquivo (alinhado às páginas):
+ * MADV_WILLNEED antes de ler um trecho, MADV_DONTNEED para tirar do
+ * processo as páginas já usadas. Não faz nada se o arquivo não está mapeado.
+ */
+static inline void mapped_file_advise(const MappedFile *f, size_t offset, size_t len, int advice) {
+    if (f->kind != MAPPED_MMAP || offset >= f->size) return;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset / page * page;
+    size_t end = (len < f->size - offset) ? offset + len : f->size;
+    madvise((void *)(f->data + start), end - start, advice);
+}
+
+static inline void mapped_file_close(MappedFile *f) {
+    if (f->kind == MAPPED_MMAP) munmap((void *)f->data, f->size);
+    if (f->kind == MAPPED_BUFFER) free((void *)f->data);
+    f->data = NULL;
+    f->size = 0;
+    f->kind = MAPPED_NONE;
+}
+
+#endif
@@ -0,0 +1,455 @@
+#ifndef NGRAM_TABLE_H
+#define NGRAM_TABLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// --- Hashes ---
+
+inline uint64_t hash_bytes(const char* data, size_t len) {
+    // FNV-1a 64 bits
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+inline uint64_t mix_hash(uint64_t h) {
+    // Finalizador do MurmurHash3: espalha os bits antes de indexar a tabela
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Base do hash polinomial dos n-gramas (ímpar, para ser inversível mod 2^64)
+const uint64_t NGRAM_HASH_BASE = 0x100000001b3ULL;
+
+// --- Especialização por N ---
+
+// Maior N com instância própria dos laços quentes; acima dele, N é lido em tempo de execução
+const int NGRAM_FIXED_MAX = 8;
+
+/**
+ * Chama fn(std::integral_constant<int, K>()) com K = n se 1 <= n <=
+ * NGRAM_FIXED_MAX, ou com K = 0 (a versão genérica) se n é maior. Com K
+ * constante, as comparações e cópias de chaves têm tamanho fixo e o
+ * compilador as desenrola, e os laços sobre as palavras de um n-grama
+ * também.
+ */
+template <typename Fn>
+inline void with_fixed_n(int n, Fn fn) {
+    switch (n) {
+        case 1: fn(std::integral_constant<int, 1>()); break;
+        case 2: fn(std::integral_constant<int, 2>()); break;
+        case 3: fn(std::integral_constant<int, 3>()); break;
+        case 4: fn(std::integral_constant<int, 4>()); break;
+        case 5: fn(std::integral_constant<int, 5>()); break;
+        case 6: fn(std::integral_constant<int, 6>()); break;
+        case 7: fn(std::integral_constant<int, 7>()); break;
+        case 8: fn(std::integral_constant<int, 8>()); break;
+        default: fn(std::integral_constant<int, 0>());
+    }
+}
+
+// --- Vocabulário ---
+
+/**
+ * Mapeia cada palavra distinta para um ID de 32 bits.
+ * As palavras ficam contíguas em `chars`; a busca é por endereçamento aberto.
+ */
+class Vocabulary {
+public:
+    Vocabulary() : slots(1024, 0) {}
+
+    uint32_t intern(const char* word, size_t len) {
+        uint64_t h = hash_bytes(word, len);
+        size_t mask = slots.size() - 1;
+        size_t pos = mix_hash(h) & mask;
+        while (slots[pos] != 0) {
+            uint32_t id = slots[pos] - 1;
+            if (hashes[id] == h && length(id) == len && memcmp(data(id), word, len) == 0) return id;
+            pos = (pos + 1) & mask;
+        }
+        uint32_t id = (uint32_t)hashes.size();
+        slots[pos] = id + 1;
+        hashes.push_back(h);
+        offsets.push_back(chars.size());
+        chars.append(word, len);
+        if (hashes.size() * 2 > slots.size()) grow();
+        return id;
+    }
+
+    size_t size() const { return hashes.size(); }
+    const char* data(uint32_t id) const { return chars.data() + offsets[id]; }
+    size_t length(uint32_t id) const {
+        return ((id + 1 < offsets.size()) ? offsets[id + 1] : chars.size()) - offsets[id];
+    }
+    // Hash do texto da palavra: igual em todos os processos, ao contrário do ID
+    uint64_t word_hash(uint32_t id) const { return hashes[id]; }
+
+    size_t memory_bytes() const {
+        return chars.capacity() + offsets.capacity() * sizeof(size_t) + hashes.capacity() * sizeof(uint64_t) +
+               slots.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    void grow() {
+        std::vector<uint32_t> new_slots(slots.size() * 2, 0);
+        size_t mask = new_slots.size() - 1;
+        for (uint32_t id = 0; id < hashes.size(); id++) {
+            size_t pos = mix_hash(hashes[id]) & mask;
+            while (new_slots[pos] != 0) pos = (pos + 1) & mask;
+            new_slots[pos] = id + 1;
+        }
+        slots.swap(new_slots);
+    }
+
+    std::string chars;
+    std::vector<size_t> offsets;
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> slots; // ID + 1; 0 = vazio
+};
+
+// --- Tabela de Contagem ---
+
+/**
+ * Alocador "bump pointer" para as chaves: blocos grandes preenchidos em
+ * sequência, liberados todos de uma vez junto com a tabela. Os ponteiros
+ * devolvidos continuam válidos quando novos blocos são criados.
+ */
+class KeyArena {
+public:
+    KeyArena() : used(BLOCK_WORDS) {}
+
+    uint32_t* alloc(size_t words) {
+        if (used + words > BLOCK_WORDS) {
+            size_t block_words = BLOCK_WORDS;
+            if (words > block_words) block_words = words;
+            blocks.push_back(std::unique_ptr<uint32_t[]>(new uint32_t[block_words]));
+            used = 0;
+            if (block_words > BLOCK_WORDS) {
+                // Bloco exclusivo para uma chave enorme; o próximo alloc abre outro
+                used = BLOCK_WORDS;
+                return blocks.back().get();
+            }
+        }
+        uint32_t* p = blocks.back().get() + used;
+        used += words;
+        return p;
+    }
+
+    size_t bytes() const { return blocks.size() * BLOCK_WORDS * sizeof(uint32_t); }
+
+private:
+    static const size_t BLOCK_WORDS = 1 << 16;
+    std::vector<std::unique_ptr<uint32_t[]> > blocks;
+    size_t used;
+};
+
+/**
+ * Contagem de n-gramas representados como tuplas de N IDs do vocabulário.
+ *
+ * Endereçamento aberto com Robin Hood: cada slot guarda o hash (já misturado)
+ * e o índice da entrada, então a sondagem compara hashes sem sair do vetor de
+ * slots, e a distância de cada elemento à sua posição ideal sai do próprio
+ * hash. As chaves ficam numa KeyArena, sem uma alocação por entrada.
+ *
+ * O hash de um n-grama depende só do texto das palavras (ver Vocabulary::word_hash),
+ * então merge() reaproveita os hashes da outra tabela sem recalcular nada.
+ */
+class NgramTable {
+public:
+    explicit NgramTable(int n) : N(n), slots(1024) {}
+
+    int n() const { return N; }
+    size_t size() const { return entries.size(); }
+    const uint32_t* key(size_t e) const { return entries[e].key; }
+    uint32_t count(size_t e) const { return entries[e].count; }
+    uint64_t hash(size_t e) const { return entries[e].hash; }
+
+    /**
+     * Soma `count` ao n-grama `ids`, cujo hash polinomial (não misturado) é
+     * h. FIXED_N, se não for 0, é o N da tabela conhecido na compilação
+     * (ver with_fixed_n).
+     */
+    template <int FIXED_N = 0>
+    void add(const uint32_t* ids, uint64_t h, uint32_t count) {
+        insert<FIXED_N>(ids, mix_hash(h), count);
+    }
+
+    // O mesmo que add, com o hash já misturado (como o de hash(e))
+    template <int FIXED_N = 0>
+    void add_mixed(const uint32_t* ids, uint64_t hm, uint32_t count) {
+        insert<FIXED_N>(ids, hm, count);
+    }
+
+    // Prepara a tabela para `n` entradas sem crescer durante as inserções
+    void reserve(size_t n) {
+        entries.reserve(n);
+        size_t capacity = slots.size();
+        while (n * 5 > capacity * 4) capacity *= 2;
+        if (capacity != slots.size()) rehash(capacity);
+    }
+
+    // Soma a entrada e de `src`, que usa o mesmo vocabulário, nesta tabela
+    void add_entry(const NgramTable& src, size_t e) {
+        insert<0>(src.key(e), src.hash(e), src.count(e));
+    }
+
+    /**
+     * Soma todas as entradas de `src` nesta tabela. Se as tabelas usam
+     * vocabulários diferentes, remap[id de src] dá o ID equivalente aqui.
+     */
+    void merge(const NgramTable& src, const uint32_t* remap = NULL) {
+        reserve(size() + src.size());
+        MergeKeys merge_keys = { this, &src, remap };
+        with_fixed_n(N, merge_keys);
+    }
+
+    // Estatísticas de ocupação, para diagnóstico
+    double load_factor() const { return (double)size() / slots.size(); }
+
+    // Distância média e máxima de cada entrada à sua posição ideal
+    void probe_lengths(double& mean, size_t& max) const {
+        size_t mask = slots.size() - 1, total = 0;
+        max = 0;
+        for (size_t pos = 0; pos < slots.size(); pos++) {
+            if (slots[pos].entry == EMPTY) continue;
+            size_t dist = (pos - (slots[pos].hash & mask)) & mask;
+            total += dist;
+            max = std::max(max, dist);
+        }
+        mean = size() > 0 ? (double)total / size() : 0;
+    }
+    size_t memory_bytes() const {
+        return slots.size() * sizeof(Slot) + entries.capacity() * sizeof(Entry) + arena.bytes();
+    }
+
+private:
+    static const uint32_t EMPTY = 0xFFFFFFFFu;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t entry;
+        Slot() : hash(0), entry(EMPTY) {}
+    };
+
+    struct Entry {
+        const uint32_t* key;
+        uint64_t hash;
+        uint32_t count;
+    };
+
+    // O laço de merge() instanciado para o N da tabela
+    struct MergeKeys {
+        NgramTable* dest;
+        const NgramTable* src;
+        const uint32_t* remap;
+
+        template <typename Fixed>
+        void operator()(Fixed) const {
+            const int n = Fixed::value > 0 ? Fixed::value : dest->N;
+            std::vector<uint32_t> ids(n);
+            for (size_t e = 0; e < src->size(); e++) {
+                const uint32_t* key = src->key(e);
+                if (remap) {
+                    for (int j = 0; j < n; j++) ids[j] = remap[key[j]];
+                    key = &ids[0];
+                }
+                dest->insert<Fixed::value>(key, src->hash(e), src->count(e));
+            }
+        }
+    };
+
+    template <int FIXED_N = 0>
+    void insert(const uint32_t* ids, uint64_t hm, uint32_t count) {
+        const size_t key_bytes = (FIXED_N > 0 ? FIXED_N : N) * sizeof(uint32_t);
+        size_t mask = slots.size() - 1;
+        size_t pos = hm & mask;
+        size_t dist = 0;
+        while (true) {
+            Slot& s = slots[pos];
+            if (s.entry == EMPTY) {
+                s.hash = hm;
+                s.entry = new_entry(ids, key_bytes, hm, count);
+                break;
+            }
+            if (s.hash == hm && memcmp(entries[s.entry].key, ids, key_bytes) == 0) {
+                entries[s.entry].count += count;
+                return;
+            }
+            size_t s_dist = (pos - (s.hash & mask)) & mask;
+            if (s_dist < dist) {
+                // Robin Hood: o novo elemento fica com o slot de quem está
+                // mais perto de casa, e o deslocado segue sondando
+                Slot displaced = s;
+                s.hash = hm;
+                s.entry = new_entry(ids, key_bytes, hm, count);
+                place(displaced, (pos + 1) & mask, s_dist + 1);
+                break;
+            }
+            pos = (pos + 1) & mask;
+            dist++;
+        }
+        if (entries.size() * 5 > slots.size() * 4) rehash(slots.size() * 2);
+    }
+
+    // Recoloca um slot já existente (sem comparar chaves), a partir de pos
+    void place(Slot moving, size_t pos, size_t dist) {
+        size_t mask = slots.size() - 1;
+        while (slots[pos].entry != EMPTY) {
+            size_t s_dist = (pos - (slots[pos].hash & mask)) & mask;
+            if (s_dist < dist) {
+                Slot tmp = slots[pos];
+                slots[pos] = moving;
+                moving = tmp;
+                dist = s_dist;
+            }
+            pos = (pos + 1) & mask;
+            dist++;
+        }
+        slots[pos] = moving;
+    }
+
+    uint32_t new_entry(const uint32_t* ids, size_t key_bytes, uint64_t hm, uint32_t count) {
+        Entry e;
+        uint32_t* key = arena.alloc(N);
+        memcpy(key, ids, key_bytes);
+        e.key = key;
+        e.hash = hm;
+        e.count = count;
+        entries.push_back(e);
+        return (uint32_t)(entries.size() - 1);
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> old;
+        old.swap(slots);
+        slots.resize(capacity);
+        size_t mask = capacity - 1;
+        for (size_t i = 0; i < old.size(); i++) {
+            if (old[i].entry != EMPTY) place(old[i], old[i].hash & mask, 0);
+        }
+    }
+
+    int N;
+    std::vector<Slot> slots;
+    std::vector<Entry> entries;
+    KeyArena arena;
+};
+
+/**
+ * Resultado de contagem de um processo: a tabela e o vocabulário dos seus IDs.
+ */
+struct NgramCounts {
+    Vocabulary vocab;
+    NgramTable table;
+
+    explicit NgramCounts(int n) : table(n) {}
+
+    // Soma outra contagem, traduzindo os IDs do vocabulário dela para este
+    void merge(const NgramCounts& other) {
+        std::vector<uint32_t> remap(other.vocab.size());
+        for (uint32_t id = 0; id < remap.size(); id++) {
+            remap[id] = vocab.intern(other.vocab.data(id), other.vocab.length(id));
+        }
+        table.merge(other.table, remap.empty() ? NULL : &remap[0]);
+    }
+
+    size_t memory_bytes() const { return vocab.memory_bytes() + table.memory_bytes(); }
+
+    // Soma `count` a um n-grama dado como texto ("w1 w2 ... wN")
+    void add_text(const char* ngram, size_t len, uint32_t count) {
+        int N = table.n();
+        std::vector<uint32_t> ids(N);
+        uint64_t h = 0;
+        size_t start = 0;
+        for (int j = 0; j < N; j++) {
+            size_t end = start;
+            while (end < len && ngram[end] != ' ') end++;
+            ids[j] = vocab.intern(ngram + start, end - start);
+            h = h * NGRAM_HASH_BASE + vocab.word_hash(ids[j]);
+            start = end + 1;
+        }
+        table.add(&ids[0], h, count);
+    }
+
+    // Texto do n-grama da entrada e, com as palavras separadas por espaço
+    void ngram_text(size_t e, std::string& out) const { ngram_text_of(vocab, table, e, out); }
+
+    static void ngram_text_of(const Vocabulary& vocab, const NgramTable& table, size_t e, std::string& out) {
+        const uint32_t* ids = table.key(e);
+        out.assign(vocab.data(ids[0]), vocab.length(ids[0]));
+        for (int j = 1; j < table.n(); j++) {
+            out += ' ';
+            out.append(vocab.data(ids[j]), vocab.length(ids[j]));
+        }
+    }
+};
+
+/**
+ * Contagens de vários tamanhos de n-grama sobre os mesmos tokens: um único
+ * vocabulário e uma tabela por N, para que o texto seja tokenizado uma vez só.
+ */
+struct NgramCountSet {
+    Vocabulary vocab;
+    std::vector<NgramTable> tables;
+
+    explicit NgramCountSet(const std::vector<int>& ns) {
+        for (size_t i = 0; i < ns.size(); i++) tables.push_back(NgramTable(ns[i]));
+    }
+
+    bool empty() const {
+        for (size_t i = 0; i < tables.size(); i++) {
+            if (tables[i].size() > 0) return false;
+        }
+        return true;
+    }
+
+    // Soma outro conjunto com os mesmos N, traduzindo os IDs uma vez para todas as tabelas
+    void merge(const NgramCountSet& other) {
+        std::vector<uint32_t> remap(other.vocab.size());
+        for (uint32_t id = 0; id < remap.size(); id++) {
+            remap[id] = vocab.intern(other.vocab.data(id), other.vocab.length(id));
+        }
+        for (size_t i = 0; i < tables.size(); i++) {
+            tables[i].merge(other.tables[i], remap.empty() ? NULL : &remap[0]);
+        }
+    }
+
+    size_t memory_bytes() const {
+        size_t bytes = vocab.memory_bytes();
+        for (size_t i = 0; i < tables.size(); i++) bytes += tables[i].memory_bytes();
+        return bytes;
+    }
+
+    // Esvazia tudo, mantendo os N
+    void clear() {
+        vocab = Vocabulary();
+        for (size_t i = 0; i < tables.size(); i++) tables[i] = NgramTable(tables[i].n());
+    }
+
+    /**
+     * Tira a tabela i do conjunto como uma NgramCounts independente. O
+     * vocabulário é copiado, exceto na última tabela, que o leva consigo.
+     */
+    NgramCounts release(size_t i) {
+        NgramCounts counts(tables[i].n());
+        counts.vocab = (i + 1 == tables.size()) ? std::move(vocab) : vocab;
+        counts.table = std::move(tables[i]);
+        tables[i] = NgramTable(counts.table.n());
+        return counts;
+    }
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef NGRAM_WIRE_H
+#define NGRAM_WIRE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "ngram_table.h"
+
+/**
+ * Formato binário de uma NgramCounts (ou de parte dela), enviado numa
+ * única mensagem:
+ *
+ *   [magic "NGRM"] [versão u8] [N u8] [2 bytes reservados]
+ *   [varint palavras] [varint entradas]
+ *   vocabulário: só as palavras usadas, em ordem lexicográfica e com
+ *                codificação de prefixo: [varint prefixo comum com a anterior]
+ *                [varint tamanho do sufixo] [sufixo]
+ *   entradas:    [N varints com o índice de cada palavra no vocabulário acima]
+ *                [varint contagem]
+ *
+ * O texto de cada palavra aparece uma vez por mensagem, não uma vez por
+ * n-grama, e as contagens (quase sempre 1) ocupam um byte. O hash de cada
+ * n-grama não é enviado: o receptor o recalcula a partir das palavras.
+ */
+
+const char NGRAM_WIRE_MAGIC[4] = { 'N', 'G', 'R', 'M' };
+const uint8_t NGRAM_WIRE_VERSION = 1;
+const size_t NGRAM_WIRE_HEADER = 8;
+
+inline void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += (char)((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+// Lê um varint de [*p, end); devolve false se a mensagem estiver truncada
+inline bool get_varint(const char*& p, const char* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = (uint8_t)*p++;
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+struct WordOrder {
+    const Vocabulary* vocab;
+    bool operator()(uint32_t a, uint32_t b) const {
+        size_t la = vocab->length(a), lb = vocab->length(b);
+        int c = memcmp(vocab->data(a), vocab->data(b), std::min(la, lb));
+        return c != 0 ? c < 0 : la < lb;
+    }
+};
+
+/**
+ * Serializa as entradas `entries` de `counts` (todas, se entries for nulo),
+ * acrescentando a mensagem ao fim de `out`.
+ */
+inline void serializeNgrams(const NgramCounts& counts, const std::vector<uint32_t>* entries, std::string& out) {
+    const NgramTable& table = counts.table;
+    int N = table.n();
+    size_t num_entries = entries ? entries->size() : table.size();
+
+    // 1. Palavras usadas por estas entradas, em ordem lexicográfica
+    const uint32_t UNUSED = 0xFFFFFFFFu;
+    std::vector<uint32_t> wire_id(counts.vocab.size(), UNUSED);
+    std::vector<uint32_t> words;
+    for (size_t i = 0; i < num_entries; i++) {
+        const uint32_t* key = table.key(entries ? (*entries)[i] : i);
+        for (int j = 0; j < N; j++) {
+            if (wire_id[key[j]] == UNUSED) {
+                wire_id[key[j]] = 0;
+                words.push_back(key[j]);
+            }
+        }
+    }
+    WordOrder order = { &counts.vocab };
+    std::sort(words.begin(), words.end(), order);
+    for (size_t w = 0; w < words.size(); w++) wire_id[words[w]] = (uint32_t)w;
+
+    // 2. Cabeçalho
+    out.append(NGRAM_WIRE_MAGIC, 4);
+    out += (char)NGRAM_WIRE_VERSION;
+    out += (char)N;
+    out.append(2, '\0');
+    put_varint(out, words.size());
+    put_varint(out, num_entries);
+
+    // 3. Vocabulário com codificação de prefixo
+    const char* prev = NULL;
+    size_t prev_len = 0;
+    for (size_t w = 0; w < words.size(); w++) {
+        const char* word = counts.vocab.data(words[w]);
+        size_t len = counts.vocab.length(words[w]);
+        size_t common = 0;
+        while (common < len && common < prev_len && word[common] == prev[common]) common++;
+        put_varint(out, common);
+        put_varint(out, len - common);
+        out.append(word + common, len - common);
+        prev = word;
+        prev_len = len;
+    }
+
+    // 4. Entradas
+    for (size_t i = 0; i < num_entries; i++) {
+        size_t e = entries ? (*entries)[i] : i;
+        const uint32_t* key = table.key(e);
+        for (int j = 0; j < N; j++) put_varint(out, wire_id[key[j]]);
+        put_varint(out, table.count(e));
+    }
+}
+
+/**
+ * Soma em `dest` a mensagem em [buffer, buffer + len), sem montar nenhum
+ * mapa intermediário. Em `consumed` devolve quantos bytes a mensagem ocupa.
+ * Devolve false se a mensagem for inválida ou de outro N.
+ */
+inline bool mergeSerializedNgrams(const char* buffer, size_t len, NgramCounts& dest, size_t* consumed = NULL) {
+    const char* p = buffer;
+    const char* end = buffer + len;
+    int N = dest.table.n();
+    if (len < NGRAM_WIRE_HEADER || memcmp(p, NGRAM_WIRE_MAGIC, 4) != 0) return false;
+    if ((uint8_t)p[4] != NGRAM_WIRE_VERSION || (uint8_t)p[5] != N) return false;
+    p += NGRAM_WIRE_HEADER;
+
+    uint64_t num_words, num_entries;
+    if (!get_varint(p, end, num_words) || !get_varint(p, end, num_entries)) return false;
+
+    // Vocabulário: cada palavra recebe o ID equivalente no vocabulário de dest
+    std::vector<uint32_t> remap;
+    remap.reserve(num_words);
+    std::string word;
+    for (uint64_t w = 0; w < num_words; w++) {
+        uint64_t common, suffix;
+        if (!get_varint(p, end, common) || !get_varint(p, end, suffix)) return false;
+        if (common > word.length() || suffix > (uint64_t)(end - p)) return false;
+        word.resize(common);
+        word.append(p, suffix);
+        p += suffix;
+        remap.push_back(dest.vocab.intern(word.data(), word.length()));
+    }
+
+    dest.table.reserve(dest.table.size() + num_entries);
+    std::vector<uint32_t> ids(N);
+    for (uint64_t i = 0; i < num_entries; i++) {
+        uint64_t h = 0, v;
+        for (int j = 0; j < N; j++) {
+            if (!get_varint(p, end, v) || v >= num_words) return false;
+            ids[j] = remap[v];
+            h = h * NGRAM_HASH_BASE + dest.vocab.word_hash(ids[j]);
+        }
+        if (!get_varint(p, end, v)) return false;
+        dest.table.add(&ids[0], h, (uint32_t)v);
+    }
+    if (consumed) *consumed = p - buffer;
+    return true;
+}
+
+#endif
@@ -3,7 +3,13 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdint.h>
 #include <time.h>
+#include "mapped_file.h"
+#include "normalize.h"
+#include "radix_sort.h"
 
 // Estrutura para armazenar nossa lista dinâmica de strings (tokens ou n-gramas)
 typedef struct {
@@ -54,211 +60,332 @@ void freeList(StringList *list) {
     list->capacity = 0;
 }
 
-// Função de comparação para o qsort
-int compareStrings(const void *a, const void *b) {
-    return strcmp(*(const char **)a, *(const char **)b);
-}
+// Lista dinâmica de ids de palavras (o texto tokenizado)
+typedef struct {
+    uint32_t *items;
+    size_t size;
+    size_t capacity;
+} IdList;
 
-// Lê um arquivo inteiro para uma string alocada dinamicamente.
-// Retorna ponteiro para a string (deve ser free'd pelo chamador) ou NULL em erro.
-char *read_file_to_string(const char *path) {
-    FILE *f = fopen(path, "rb");
-    if (!f) {
-        fprintf(stderr, "Erro ao abrir arquivo '%s': %s\n", path, strerror(errno));
-        return NULL;
+void addId(IdList *list, uint32_t id) {
+    if (list->size == list->capacity) {
+        list->capacity = list->capacity ? 2 * list->capacity : 1024;
+        list->items = (uint32_t *)realloc(list->items, list->capacity * sizeof(uint32_t));
+        if (list->items == NULL) {
+            fprintf(stderr, "Falha ao realocar memória\n");
+            exit(1);
+        }
     }
+    list->items[list->size++] = id;
+}
 
-    // Tenta descobrir o tamanho usando fseek/ftell
-    if (fseek(f, 0, SEEK_END) == 0) {
-        long sz = ftell(f);
-        if (sz >= 0) {
-            rewind(f);
-            char *buf = (char *)malloc((size_t)sz + 1);
-            if (!buf) {
-                fprintf(stderr, "Falha ao alocar %ld bytes\n", sz + 1);
-                fclose(f);
-                return NULL;
-            }
-            size_t read = fread(buf, 1, (size_t)sz, f);
-            buf[read] = '\0';
-            fclose(f);
-            return buf;
-        }
-        // Se ftell falhar, iremos para leitura por chunks
-        rewind(f);
+// Vocabulário: cada palavra distinta guardada uma vez, com um id; a busca é
+// uma tabela hash de endereçamento aberto sobre os ids
+typedef struct {
+    StringList words;   // words.items[id]
+    uint32_t *slots;    // id + 1, ou 0 se vazio
+    size_t mask;
+} Vocabulary;
+
+static uint64_t hashWord(const char *word) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (; *word; word++) h = (h ^ (unsigned char)*word) * 1099511628211ULL;
+    return h;
+}
+
+void initVocabulary(Vocabulary *vocab) {
+    initList(&vocab->words, 1024);
+    vocab->mask = 4095;
+    vocab->slots = (uint32_t *)calloc(vocab->mask + 1, sizeof(uint32_t));
+    if (vocab->slots == NULL) {
+        fprintf(stderr, "Falha ao alocar memória\n");
+        exit(1);
     }
+}
 
-    // Fallback: lê em blocos quando o tamanho não é conhecido
-    size_t capacity = 8192;
-    char *buf = (char *)malloc(capacity);
-    if (!buf) {
-        fprintf(stderr, "Falha ao alocar buffer inicial\n");
-        fclose(f);
-        return NULL;
+// Posição de `word` na tabela: a que tem o seu id, ou a vazia onde ele entraria
+static size_t findSlot(const Vocabulary *vocab, const char *word) {
+    size_t pos = hashWord(word) & vocab->mask;
+    while (vocab->slots[pos] && strcmp(vocab->words.items[vocab->slots[pos] - 1], word) != 0) {
+        pos = (pos + 1) & vocab->mask;
     }
-    size_t len = 0;
-    size_t n;
-    while ((n = fread(buf + len, 1, capacity - len, f)) > 0) {
-        len += n;
-        if (len == capacity) {
-            capacity *= 2;
-            char *tmp = (char *)realloc(buf, capacity);
-            if (!tmp) {
-                fprintf(stderr, "Falha ao realocar buffer para %zu bytes\n", capacity);
-                free(buf);
-                fclose(f);
-                return NULL;
-            }
-            buf = tmp;
+    return pos;
+}
+
+// Id de `word`, que é acrescentada ao vocabulário se ainda não estiver nele
+uint32_t internWord(Vocabulary *vocab, const char *word) {
+    size_t pos = findSlot(vocab, word);
+    if (vocab->slots[pos]) return vocab->slots[pos] - 1;
+
+    addToList(&vocab->words, word);
+    vocab->slots[pos] = vocab->words.size;
+    if ((size_t)vocab->words.size * 2 > vocab->mask) {
+        // Mais da metade ocupada: dobra a tabela e reinsere os ids
+        free(vocab->slots);
+        vocab->mask = vocab->mask * 2 + 1;
+        vocab->slots = (uint32_t *)calloc(vocab->mask + 1, sizeof(uint32_t));
+        if (vocab->slots == NULL) {
+            fprintf(stderr, "Falha ao alocar memória\n");
+            exit(1);
+        }
+        for (int id = 0; id < vocab->words.size; id++) {
+            vocab->slots[findSlot(vocab, vocab->words.items[id])] = id + 1;
         }
     }
-    buf[len] = '\0';
-    fclose(f);
-    return buf;
+    return vocab->words.size - 1;
+}
+
+void freeVocabulary(Vocabulary *vocab) {
+    freeList(&vocab->words);
+    free(vocab->slots);
+}
+
+// Função de comparação para o qsort
+int compareStrings(const void *a, const void *b) {
+    return strcmp(*(const char **)a, *(const char **)b);
 }
 
 // --- Funções Principais do Algoritmo ---
 
+// Os mesmos separadores de palavras do parallel (ver tokenizer.h)
+static int isSeparator(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
 /**
  * 1. Tokeniza e Normaliza o texto.
  * Quebra o texto em palavras, converte para minúsculo e remove pontuação.
+ * O que conta como letra depende de `mode` (ver normalize.h). Cada palavra
+ * vira o seu id no vocabulário.
  */
-void tokenize(const char *text, StringList *tokens) {
-    char *text_copy = strdup(text); // Copia para podermos modificar
-    char *buffer = text_copy;
-    char *token;
-
-    while ((token = strsep(&buffer, " \n\t\r")) != NULL) {
-        if (strlen(token) == 0) continue;
+void tokenize(const char *text, size_t text_len, Vocabulary *vocab, IdList *tokens, int mode) {
+    // O texto é só lido (pode ser o arquivo mapeado); cada palavra é
+    // normalizada num buffer reaproveitado
+    size_t capacity = 256;
+    char *cleaned_token = (char *)malloc(capacity);
+    size_t i = 0;
+    while (i < text_len) {
+        while (i < text_len && isSeparator(text[i])) i++;
+        size_t start = i;
+        while (i < text_len && !isSeparator(text[i])) i++;
+        size_t len = i - start;
+        if (len == 0) continue;
 
         // Normalização: minúsculo e remoção de pontuação
-        char *cleaned_token = (char *)malloc(strlen(token) + 1);
-        int j = 0;
-        for (int i = 0; token[i]; i++) {
-            if (isalpha(token[i])) { // Mantém apenas letras
-                cleaned_token[j++] = tolower(token[i]);
-            }
+        if (2 * len + 1 > capacity) { // Latin-1 -> UTF-8 pode dobrar
+            capacity = 2 * len + 1;
+            cleaned_token = (char *)realloc(cleaned_token, capacity);
+        }
+        if (!cleaned_token) {
+            fprintf(stderr, "Falha ao alocar memória\n");
+            exit(1);
         }
+        size_t j = norm_word(text + start, len, mode, cleaned_token);
         cleaned_token[j] = '\0';
 
-        if (strlen(cleaned_token) > 0) {
-            addToList(tokens, cleaned_token);
+        if (j > 0) {
+            addId(tokens, internWord(vocab, cleaned_token));
         }
-        free(cleaned_token);
     }
-    free(text_copy);
+    free(cleaned_token);
 }
 
 /**
- * 2. Gera todos os N-gramas a partir da lista de tokens.
+ * 2. Renumera o vocabulário em ordem alfabética (strcmp), para que a ordem
+ * das chaves dos n-gramas seja a ordem do texto deles. Só as palavras
+ * distintas são ordenadas com qsort; os tokens são só remapeados.
  */
-void generateNgrams(StringList *tokens, int N, StringList *ngrams) {
-    size_t buffer_size = 2048;
-    char *ngram_buffer = malloc(buffer_size); 
-    if (!ngram_buffer) {printf("Erro ao alocar buffer\n");return; }
-    for (int i = 0; i <= tokens->size - N; i++) {
-        ngram_buffer[0] = '\0'; // Limpa o buffer
-
-        // Concatena N tokens
-        for (int j = 0; j < N; j++) {
-            strcat(ngram_buffer, tokens->items[i + j]);
-            if (j < N - 1) {
-                strcat(ngram_buffer, " "); // Adiciona espaço entre as palavras
-            }
-        }
-        addToList(ngrams, ngram_buffer);
+void sortVocabulary(Vocabulary *vocab, IdList *tokens) {
+    int size = vocab->words.size;
+    char **sorted = (char **)malloc((size + 1) * sizeof(char *));
+    uint32_t *rank = (uint32_t *)malloc((size + 1) * sizeof(uint32_t));
+    if (!sorted || !rank) {
+        fprintf(stderr, "Falha ao alocar memória\n");
+        exit(1);
     }
-    free(ngram_buffer);
+    memcpy(sorted, vocab->words.items, size * sizeof(char *));
+    qsort(sorted, size, sizeof(char *), compareStrings);
+    for (int i = 0; i < size; i++) {
+        rank[vocab->slots[findSlot(vocab, sorted[i])] - 1] = i;
+    }
+    for (size_t i = 0; i < tokens->size; i++) tokens->items[i] = rank[tokens->items[i]];
+    memcpy(vocab->words.items, sorted, size * sizeof(char *));
+    memset(vocab->slots, 0, (vocab->mask + 1) * sizeof(uint32_t));
+    for (int i = 0; i < size; i++) vocab->slots[findSlot(vocab, sorted[i])] = i + 1;
+    free(sorted);
+    free(rank);
 }
 
 /**
- * 4. Conta, Filtra e Imprime os N-gramas que atingem o limiar.
- * Esta função assume que a lista 'ngrams' já está ordenada.
+ * 3. Gera todos os N-gramas a partir da lista de tokens, como chaves de
+ * largura fixa (ver radix_sort.h) num único vetor. Devolve quantos são.
  */
-void countAndFilter(StringList *sorted_ngrams, int min_threshold) {
-    if (sorted_ngrams->size == 0) return;
+size_t generateNgrams(const IdList *tokens, int N, int bits, int words, uint64_t **keys) {
+    size_t count = (tokens->size >= (size_t)N) ? tokens->size - N + 1 : 0;
+    *keys = (uint64_t *)malloc((count + 1) * words * sizeof(uint64_t));
+    if (!*keys) {
+        fprintf(stderr, "Falha ao alocar memória para %zu n-gramas\n", count);
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        radix_pack(*keys + i * words, words, tokens->items + i, N, bits);
+    }
+    return count;
+}
 
-    int current_count = 1;
-    char *current_ngram = sorted_ngrams->items[0];
-    int total_ngrams = sorted_ngrams->size;
+// Texto do n-grama de uma chave, com as palavras separadas por espaço
+static void printNgram(const Vocabulary *vocab, const uint64_t *key, int words, uint32_t *ids, int N, int bits) {
+    radix_unpack(key, words, ids, N, bits);
+    for (int j = 0; j < N; j++) {
+        if (j > 0) putchar(' ');
+        fputs(vocab->words.items[ids[j]], stdout);
+    }
+}
+
+/**
+ * 5. Conta, Filtra e Imprime os N-gramas que atingem o limiar.
+ * Esta função assume que as chaves já estão ordenadas: os n-gramas iguais
+ * estão em sequência.
+ */
+void countAndFilter(const Vocabulary *vocab, const uint64_t *keys, size_t total_ngrams, int N, int bits, int words,
+                    int min_threshold) {
+    if (total_ngrams == 0) return;
 
+    uint32_t *ids = (uint32_t *)malloc(N * sizeof(uint32_t));
     printf("--- N-gramas Significativos (Limiar: %d) ---\n", min_threshold);
 
-    for (int i = 1; i < sorted_ngrams->size; i++) {
-        if (strcmp(current_ngram, sorted_ngrams->items[i]) == 0) {
-            // N-grama é o mesmo, incrementa a contagem
-            current_count++;
-        } else {
-            // N-grama mudou, verifica o anterior
-            if (current_count >= min_threshold) {
-                double relative_freq = (double)current_count / total_ngrams;
-                printf("'%s' \t (Contagem: %d, Frequência: %.4f%%)\n",
-                       current_ngram, current_count, relative_freq * 100.0);
-            }
-            // Reseta para o novo N-grama
-            current_ngram = sorted_ngrams->items[i];
-            current_count = 1;
+    size_t run_start = 0;
+    for (size_t i = 1; i <= total_ngrams; i++) {
+        if (i < total_ngrams && radix_key_equal(keys + i * words, keys + run_start * words, words)) {
+            continue; // N-grama é o mesmo
+        }
+        // N-grama mudou (ou acabou), verifica o anterior
+        size_t current_count = i - run_start;
+        if (current_count >= (size_t)min_threshold) {
+            double relative_freq = (double)current_count / total_ngrams;
+            putchar('\'');
+            printNgram(vocab, keys + run_start * words, words, ids, N, bits);
+            printf("' \t (Contagem: %zu, Frequência: %.4f%%)\n", current_count, relative_freq * 100.0);
         }
+        run_start = i;
     }
+    free(ids);
+}
+
+// --- Função Principal ---
 
-    // Verifica o último N-grama do loop
-    if (current_count >= min_threshold) {
-        double relative_freq = (double)current_count / total_ngrams;
-        printf("'%s' \t (Contagem: %d, Frequência: %.4f%%)\n",
-               current_ngram, current_count, relative_freq * 100.0);
+// Inteiro decimal em [lo, hi], sem sobras depois dos dígitos; avisa se não for
+static int parse_int(const char *name, const char *text, long lo, long hi, int *out) {
+    char *end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || value < lo || value > hi) {
+        fprintf(stderr, "Valor inválido para --%s: %s\n", name, text);
+        return 0;
     }
+    *out = (int)value;
+    return 1;
 }
 
-// --- Função Principal ---
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Uso: %s [opções] [arquivo]\n"
+            "  -n, --n N                tamanho do N-grama (padrão 5)\n"
+            "  -t, --threshold T        limiar mínimo de ocorrências para exibir (padrão 2)\n"
+            "      --normalize MODO     ascii | utf8 | strip (padrão utf8)\n"
+            "      --threads T          threads da ordenação dos n-gramas (padrão 1)\n"
+            "      --mmap 0|1           lê a entrada com mmap, ou com read() (padrão 1)\n"
+            "O arquivo padrão é big_bible.txt. As opções têm o mesmo significado que no parallel.\n",
+            prog);
+}
 
-int main() {
+int main(int argc, char *argv[]) {
     const char *input_path = "big_bible.txt";
-    int N = 6; // tamanho do N-gram (ex: 1=unigramas, 2=bigramas)
+    int N = 5; // tamanho do N-gram (ex: 1=unigramas, 2=bigramas); o mesmo --n do parallel
     int MIN_THRESHOLD = 2; // limiar mínimo de ocorrências de um N-gram para ser exibido
-
-    // Lê todo o arquivo para uma string
-    char *text = read_file_to_string(input_path);
-    if (!text) {
+    int NORMALIZATION = NORM_UTF8; // o que conta como letra; o mesmo --normalize do parallel
+    int THREADS = 1; // threads da ordenação; o mesmo --threads do parallel
+    int USE_MMAP = 1; // lê a entrada com mmap (0: com read); o mesmo --mmap do parallel
+
+    static const struct option options[] = {
+        { "n", required_argument, NULL, 'n' },
+        { "threshold", required_argument, NULL, 't' },
+        { "normalize", required_argument, NULL, 'z' },
+        { "threads", required_argument, NULL, 'T' },
+        { "mmap", required_argument, NULL, 'm' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c, ok = 1;
+    while ((c = getopt_long(argc, argv, "n:t:h", options, NULL)) != -1) {
+        switch (c) {
+            case 'n': ok &= parse_int("n", optarg, 1, 255, &N); break;
+            case 't': ok &= parse_int("threshold", optarg, 1, INT_MAX, &MIN_THRESHOLD); break;
+            case 'z':
+                if (strcmp(optarg, "ascii") == 0) NORMALIZATION = NORM_ASCII;
+                else if (strcmp(optarg, "utf8") == 0) NORMALIZATION = NORM_UTF8;
+                else if (strcmp(optarg, "strip") == 0) NORMALIZATION = NORM_UTF8_STRIP;
+                else NORMALIZATION = -1;
+                break;
+            case 'T': ok &= parse_int("threads", optarg, 1, 1024, &THREADS); break;
+            case 'm': ok &= parse_int("mmap", optarg, 0, 1, &USE_MMAP); break;
+            case 'h': usage(argv[0]); return 0;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind < argc) input_path = argv[optind++];
+    if (!ok || optind < argc || NORMALIZATION < 0) {
+        usage(argv[0]);
         return 1;
     }
 
-    StringList tokens;
-    StringList ngrams;
+    // O arquivo inteiro, mapeado em memória (ou lido, se não der para mapear)
+    MappedFile input;
+    if (mapped_file_open(&input, input_path, USE_MMAP) != 0) {
+        fprintf(stderr, "Erro ao abrir arquivo '%s': %s\n", input_path, strerror(errno));
+        return 1;
+    }
 
-    initList(&tokens, 10);
-    initList(&ngrams, 10);
+    Vocabulary vocab;
+    IdList tokens = { NULL, 0, 0 };
+    initVocabulary(&vocab);
 
-    clock_t start_time, end_time;
-    start_time = clock();
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
 
     // Passo 1: Tokenizar
-    tokenize(text, &tokens);
+    tokenize(input.data, input.size, &vocab, &tokens, NORMALIZATION);
 
-    /*
-    // Descomente para ver os tokens
-    printf("--- Tokens ---\n");
-    for(int i=0; i<tokens.size; i++) {
-        printf("%d: %s\n", i, tokens.items[i]);
-    }
-    */
+    // Passo 2: Ids em ordem alfabética
+    sortVocabulary(&vocab, &tokens);
 
-    // Passo 2: Gerar N-gramas
-    generateNgrams(&tokens, N, &ngrams);
+    // Passo 3: Gerar N-gramas
+    int bits = radix_id_bits(vocab.words.size);
+    int words = radix_key_words(N, bits);
+    uint64_t *keys;
+    size_t total_ngrams = generateNgrams(&tokens, N, bits, words, &keys);
 
-    // Passo 3: Ordenar
-    qsort(ngrams.items, ngrams.size, sizeof(char *), compareStrings);
+    // Passo 4: Ordenar
+    uint64_t *tmp = (uint64_t *)malloc((total_ngrams + 1) * words * sizeof(uint64_t));
+    if (!tmp) {
+        fprintf(stderr, "Falha ao alocar memória para %zu n-gramas\n", total_ngrams);
+        return 1;
+    }
+    uint64_t *sorted = radix_sort_keys(keys, tmp, total_ngrams, words, N * bits, THREADS);
 
-    // Passo 4: Contar e Filtrar
-    countAndFilter(&ngrams, MIN_THRESHOLD);
+    // Passo 5: Contar e Filtrar
+    countAndFilter(&vocab, sorted, total_ngrams, N, bits, words, MIN_THRESHOLD);
 
-    end_time = clock();
-    double time_spent = (double)(end_time - start_time) / CLOCKS_PER_SEC;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double time_spent = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
     printf("Tempo total de processamento: %.2f segundos\n", time_spent);
 
     // Libera toda a memória
-    freeList(&tokens);
-    freeList(&ngrams);
-    free(text);
+    freeVocabulary(&vocab);
+    free(tokens.items);
+    free(keys);
+    free(tmp);
+    mapped_file_close(&input);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,184 @@
+#ifndef NODE_TABLE_H
+#define NODE_TABLE_H
+
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "ngram_table.h"
+
+/**
+ * Tabela de contagem num bloco de memória compartilhado pelos processos de
+ * um nó (--reduce node; o bloco vem de MPI_Win_allocate_shared em
+ * parallel.cpp). Todos os processos do nó inserem ao mesmo tempo, sem
+ * travas: os slots são reservados com compare-and-swap e as contagens somadas
+ * com fetch-and-add (builtins __atomic, que funcionam entre processos sobre
+ * memória compartilhada porque são livres de trava).
+ *
+ * Os IDs das palavras de cada processo são locais, então há duas tabelas:
+ *   - palavras: texto -> ID do nó, com o texto numa arena de caracteres;
+ *   - n-gramas: tuplas de N IDs do nó, com o hash já misturado de
+ *     NgramTable::hash, que depende só do texto e vale em qualquer processo.
+ * Nenhuma das duas cresce: as capacidades vêm da soma dos tamanhos locais,
+ * que limita o que o nó pode ter de distinto.
+ *
+ * Um slot passa de vazio para "sendo escrito" (CAS), tem o conteúdo gravado
+ * e é publicado com um store-release; quem o encontra sendo escrito espera.
+ */
+
+struct NodeTableSizes {
+    uint64_t words;     // Soma dos vocabulários locais
+    uint64_t chars;     // Soma dos bytes das palavras locais
+    uint64_t entries;   // Soma das entradas das tabelas locais
+};
+
+class NodeTable {
+public:
+    // Bytes do bloco para `sizes` e n-gramas de N palavras
+    static size_t bytes(const NodeTableSizes& sizes, int N) {
+        return layout(sizes, N).end;
+    }
+
+    // Usa o bloco em `base` (de bytes(sizes, N) bytes), zerado antes por um dos processos
+    NodeTable(void* base, const NodeTableSizes& sizes, int n)
+        : N(n), l(layout(sizes, n)), block((char*)base) {}
+
+    /**
+     * ID no nó da palavra word[0, len), de hash h (Vocabulary::word_hash);
+     * a primeira inserção cria o ID, em ordem de chegada.
+     */
+    uint32_t intern(const char* word, size_t len, uint64_t h) {
+        uint64_t mask = l.word_slots - 1;
+        for (uint64_t pos = mix_hash(h) & mask; ; pos = (pos + 1) & mask) {
+            uint32_t* slot = word_slot(pos);
+            uint32_t v = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+            if (v == FREE) {
+                uint32_t expected = FREE;
+                if (!__atomic_compare_exchange_n(slot, &expected, WRITING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    v = expected;
+                } else {
+                    uint32_t id = (uint32_t)__atomic_fetch_add(&header()->words, 1, __ATOMIC_RELAXED);
+                    uint64_t offset = __atomic_fetch_add(&header()->chars, len, __ATOMIC_RELAXED);
+                    memcpy(block + l.chars + offset, word, len);
+                    WordRecord* w = word_record(id);
+                    w->hash = h;
+                    w->offset = offset;
+                    w->length = len;
+                    __atomic_store_n(slot, id + 1, __ATOMIC_RELEASE);
+                    return id;
+                }
+            }
+            while (v == WRITING) {
+                sched_yield(); // Quem escreve pode estar fora da CPU (mais processos que núcleos)
+                v = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+            }
+            const WordRecord* w = word_record(v - 1);
+            if (w->hash == h && w->length == len && memcmp(block + l.chars + w->offset, word, len) == 0) return v - 1;
+        }
+    }
+
+    // Soma `count` ao n-grama de IDs do nó `ids`, com o hash misturado hm (NgramTable::hash)
+    void add(const uint32_t* ids, uint64_t hm, uint32_t count) {
+        uint64_t mask = l.ngram_slots - 1;
+        for (uint64_t pos = hm & mask; ; pos = (pos + 1) & mask) {
+            NgramSlot* s = ngram_slot(pos);
+            uint32_t state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+            if (state == FREE) {
+                uint32_t expected = FREE;
+                if (!__atomic_compare_exchange_n(&s->state, &expected, WRITING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                    state = expected;
+                } else {
+                    s->hash = hm;
+                    memcpy(s->key, ids, N * sizeof(uint32_t));
+                    __atomic_store_n(&s->count, count, __ATOMIC_RELAXED);
+                    __atomic_fetch_add(&header()->entries, 1, __ATOMIC_RELAXED);
+                    __atomic_store_n(&s->state, READY, __ATOMIC_RELEASE);
+                    return;
+                }
+            }
+            while (state == WRITING) {
+                sched_yield();
+                state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+            }
+            if (s->hash == hm && memcmp(s->key, ids, N * sizeof(uint32_t)) == 0) {
+                __atomic_fetch_add(&s->count, count, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+    }
+
+    // Leitura, depois que todos os processos do nó terminaram de inserir
+
+    size_t words() const { return header()->words; }
+    const char* word(uint32_t id) const { return block + l.chars + word_record(id)->offset; }
+    size_t word_length(uint32_t id) const { return word_record(id)->length; }
+    size_t entries() const { return header()->entries; }
+
+    size_t slots() const { return l.ngram_slots; }
+    bool used(size_t pos) const { return ngram_slot(pos)->state == READY; }
+    const uint32_t* key(size_t pos) const { return ngram_slot(pos)->key; }
+    uint64_t hash(size_t pos) const { return ngram_slot(pos)->hash; }
+    uint32_t count(size_t pos) const { return ngram_slot(pos)->count; }
+
+private:
+    static const uint32_t FREE = 0;
+    static const uint32_t WRITING = 0xFFFFFFFFu; // Nas palavras, os outros valores são ID + 1
+    static const uint32_t READY = 1;
+
+    struct Header {
+        uint64_t words;
+        uint64_t chars;
+        uint64_t entries;
+    };
+
+    struct WordRecord {
+        uint64_t hash;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    struct NgramSlot {
+        uint64_t hash;
+        uint32_t state;
+        uint32_t count;
+        uint32_t key[1]; // N IDs; o slot ocupa ngram_stride bytes
+    };
+
+    // Posições das regiões no bloco e capacidades (potências de 2, ocupação <= 0.8)
+    struct Layout {
+        uint64_t word_slots, ngram_slots, ngram_stride;
+        uint64_t word_index, word_records, chars, ngrams, end;
+    };
+
+    static uint64_t capacity_for(uint64_t n) {
+        uint64_t capacity = 16;
+        while (n * 5 > capacity * 4) capacity *= 2;
+        return capacity;
+    }
+
+    static uint64_t align(uint64_t offset) { return (offset + 7) & ~(uint64_t)7; }
+
+    static Layout layout(const NodeTableSizes& sizes, int N) {
+        Layout l;
+        l.word_slots = capacity_for(sizes.words);
+        l.ngram_slots = capacity_for(sizes.entries);
+        l.ngram_stride = align(offsetof(NgramSlot, key) + N * sizeof(uint32_t));
+        l.word_index = sizeof(Header);
+        l.word_records = align(l.word_index + l.word_slots * sizeof(uint32_t));
+        l.chars = l.word_records + sizes.words * sizeof(WordRecord);
+        l.ngrams = align(l.chars + sizes.chars);
+        l.end = l.ngrams + l.ngram_slots * l.ngram_stride;
+        return l;
+    }
+
+    Header* header() const { return (Header*)block; }
+    uint32_t* word_slot(uint64_t pos) const { return (uint32_t*)(block + l.word_index) + pos; }
+    WordRecord* word_record(uint32_t id) const { return (WordRecord*)(block + l.word_records) + id; }
+    NgramSlot* ngram_slot(uint64_t pos) const { return (NgramSlot*)(block + l.ngrams + pos * l.ngram_stride); }
+
+    int N;
+    Layout l;
+    char* block;
+};
+
+#endif
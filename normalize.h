@@ -0,0 +1,216 @@
+#ifndef NORMALIZE_H
+#define NORMALIZE_H
+
+/*
+ * Normalização de palavras comum ao ngrams.c e ao parallel.cpp (C e C++).
+ *
+ * Uma palavra normalizada mantém só as letras, em minúsculo. Há três modos:
+ *   NORM_ASCII:       só A-Z/a-z contam como letras (o comportamento original,
+ *                     que parte "coração" em "cora" + "o")
+ *   NORM_UTF8:        o texto é lido como UTF-8 e as letras latinas até U+017F
+ *                     (Latin-1 e Latin Extended-A) são mantidas, em minúsculo
+ *                     e recodificadas em UTF-8: "Coração" -> "coração"
+ *   NORM_UTF8_STRIP:  como NORM_UTF8, mas sem acentos: "Coração" -> "coracao"
+ *
+ * Bytes que não formam uma sequência UTF-8 válida são lidos como Latin-1,
+ * então arquivos em ISO-8859-1 também funcionam. Caracteres fora da tabela
+ * (pontuação como U+2014, outros alfabetos) não são letras e são descartados.
+ * Bytes ASCII são tratados por consulta direta à tabela, sem decodificação.
+ */
+
+#include <stddef.h>
+
+enum { NORM_ASCII = 0, NORM_UTF8 = 1, NORM_UTF8_STRIP = 2 };
+
+#define NORM_TABLE_SIZE 0x180
+
+/* Minúscula de cada código até U+017F; 0 = não é letra. Gerada com unicodedata. */
+static const unsigned short NORM_FOLD[NORM_TABLE_SIZE] = {
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0000 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0008 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0010 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0018 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0020 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0028 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0030 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0038 */
+    0x000, 0x061, 0x062, 0x063, 0x064, 0x065, 0x066, 0x067,  /* U+0040 */
+    0x068, 0x069, 0x06A, 0x06B, 0x06C, 0x06D, 0x06E, 0x06F,  /* U+0048 */
+    0x070, 0x071, 0x072, 0x073, 0x074, 0x075, 0x076, 0x077,  /* U+0050 */
+    0x078, 0x079, 0x07A, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0058 */
+    0x000, 0x061, 0x062, 0x063, 0x064, 0x065, 0x066, 0x067,  /* U+0060 */
+    0x068, 0x069, 0x06A, 0x06B, 0x06C, 0x06D, 0x06E, 0x06F,  /* U+0068 */
+    0x070, 0x071, 0x072, 0x073, 0x074, 0x075, 0x076, 0x077,  /* U+0070 */
+    0x078, 0x079, 0x07A, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0078 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0080 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0088 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0090 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+0098 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+00A0 */
+    0x000, 0x000, 0x0AA, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+00A8 */
+    0x000, 0x000, 0x000, 0x000, 0x000, 0x0B5, 0x000, 0x000,  /* U+00B0 */
+    0x000, 0x000, 0x0BA, 0x000, 0x000, 0x000, 0x000, 0x000,  /* U+00B8 */
+    0x0E0, 0x0E1, 0x0E2, 0x0E3, 0x0E4, 0x0E5, 0x0E6, 0x0E7,  /* U+00C0 */
+    0x0E8, 0x0E9, 0x0EA, 0x0EB, 0x0EC, 0x0ED, 0x0EE, 0x0EF,  /* U+00C8 */
+    0x0F0, 0x0F1, 0x0F2, 0x0F3, 0x0F4, 0x0F5, 0x0F6, 0x000,  /* U+00D0 */
+    0x0F8, 0x0F9, 0x0FA, 0x0FB, 0x0FC, 0x0FD, 0x0FE, 0x0DF,  /* U+00D8 */
+    0x0E0, 0x0E1, 0x0E2, 0x0E3, 0x0E4, 0x0E5, 0x0E6, 0x0E7,  /* U+00E0 */
+    0x0E8, 0x0E9, 0x0EA, 0x0EB, 0x0EC, 0x0ED, 0x0EE, 0x0EF,  /* U+00E8 */
+    0x0F0, 0x0F1, 0x0F2, 0x0F3, 0x0F4, 0x0F5, 0x0F6, 0x000,  /* U+00F0 */
+    0x0F8, 0x0F9, 0x0FA, 0x0FB, 0x0FC, 0x0FD, 0x0FE, 0x0FF,  /* U+00F8 */
+    0x101, 0x101, 0x103, 0x103, 0x105, 0x105, 0x107, 0x107,  /* U+0100 */
+    0x109, 0x109, 0x10B, 0x10B, 0x10D, 0x10D, 0x10F, 0x10F,  /* U+0108 */
+    0x111, 0x111, 0x113, 0x113, 0x115, 0x115, 0x117, 0x117,  /* U+0110 */
+    0x119, 0x119, 0x11B, 0x11B, 0x11D, 0x11D, 0x11F, 0x11F,  /* U+0118 */
+    0x121, 0x121, 0x123, 0x123, 0x125, 0x125, 0x127, 0x127,  /* U+0120 */
+    0x129, 0x129, 0x12B, 0x12B, 0x12D, 0x12D, 0x12F, 0x12F,  /* U+0128 */
+    0x069, 0x131, 0x133, 0x133, 0x135, 0x135, 0x137, 0x137,  /* U+0130 */
+    0x138, 0x13A, 0x13A, 0x13C, 0x13C, 0x13E, 0x13E, 0x140,  /* U+0138 */
+    0x140, 0x142, 0x142, 0x144, 0x144, 0x146, 0x146, 0x148,  /* U+0140 */
+    0x148, 0x149, 0x14B, 0x14B, 0x14D, 0x14D, 0x14F, 0x14F,  /* U+0148 */
+    0x151, 0x151, 0x153, 0x153, 0x155, 0x155, 0x157, 0x157,  /* U+0150 */
+    0x159, 0x159, 0x15B, 0x15B, 0x15D, 0x15D, 0x15F, 0x15F,  /* U+0158 */
+    0x161, 0x161, 0x163, 0x163, 0x165, 0x165, 0x167, 0x167,  /* U+0160 */
+    0x169, 0x169, 0x16B, 0x16B, 0x16D, 0x16D, 0x16F, 0x16F,  /* U+0168 */
+    0x171, 0x171, 0x173, 0x173, 0x175, 0x175, 0x177, 0x177,  /* U+0170 */
+    0x0FF, 0x17A, 0x17A, 0x17C, 0x17C, 0x17E, 0x17E, 0x17F,  /* U+0178 */
+};
+
+/* Forma sem acento (em minúsculo) de cada letra; "" = manter como está */
+static const char NORM_STRIP[NORM_TABLE_SIZE][3] = {
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0000 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0008 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0010 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0018 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0020 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0028 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0030 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0038 */
+    "",   "a",  "b",  "c",  "d",  "e",  "f",  "g",  /* U+0040 */
+    "h",  "i",  "j",  "k",  "l",  "m",  "n",  "o",  /* U+0048 */
+    "p",  "q",  "r",  "s",  "t",  "u",  "v",  "w",  /* U+0050 */
+    "x",  "y",  "z",  "",   "",   "",   "",   "",  /* U+0058 */
+    "",   "a",  "b",  "c",  "d",  "e",  "f",  "g",  /* U+0060 */
+    "h",  "i",  "j",  "k",  "l",  "m",  "n",  "o",  /* U+0068 */
+    "p",  "q",  "r",  "s",  "t",  "u",  "v",  "w",  /* U+0070 */
+    "x",  "y",  "z",  "",   "",   "",   "",   "",  /* U+0078 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0080 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0088 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0090 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+0098 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+00A0 */
+    "",   "",   "a",  "",   "",   "",   "",   "",  /* U+00A8 */
+    "",   "",   "",   "",   "",   "",   "",   "",  /* U+00B0 */
+    "",   "",   "o",  "",   "",   "",   "",   "",  /* U+00B8 */
+    "a",  "a",  "a",  "a",  "a",  "a",  "ae", "c",  /* U+00C0 */
+    "e",  "e",  "e",  "e",  "i",  "i",  "i",  "i",  /* U+00C8 */
+    "d",  "n",  "o",  "o",  "o",  "o",  "o",  "",  /* U+00D0 */
+    "o",  "u",  "u",  "u",  "u",  "y",  "th", "ss",  /* U+00D8 */
+    "a",  "a",  "a",  "a",  "a",  "a",  "ae", "c",  /* U+00E0 */
+    "e",  "e",  "e",  "e",  "i",  "i",  "i",  "i",  /* U+00E8 */
+    "d",  "n",  "o",  "o",  "o",  "o",  "o",  "",  /* U+00F0 */
+    "o",  "u",  "u",  "u",  "u",  "y",  "th", "y",  /* U+00F8 */
+    "a",  "a",  "a",  "a",  "a",  "a",  "c",  "c",  /* U+0100 */
+    "c",  "c",  "c",  "c",  "c",  "c",  "d",  "d",  /* U+0108 */
+    "d",  "d",  "e",  "e",  "e",  "e",  "e",  "e",  /* U+0110 */
+    "e",  "e",  "e",  "e",  "g",  "g",  "g",  "g",  /* U+0118 */
+    "g",  "g",  "g",  "g",  "h",  "h",  "h",  "h",  /* U+0120 */
+    "i",  "i",  "i",  "i",  "i",  "i",  "i",  "i",  /* U+0128 */
+    "i",  "i",  "ij", "ij", "j",  "j",  "k",  "k",  /* U+0130 */
+    "k",  "l",  "l",  "l",  "l",  "l",  "l",  "l",  /* U+0138 */
+    "l",  "l",  "l",  "n",  "n",  "n",  "n",  "n",  /* U+0140 */
+    "n",  "n",  "n",  "n",  "o",  "o",  "o",  "o",  /* U+0148 */
+    "o",  "o",  "oe", "oe", "r",  "r",  "r",  "r",  /* U+0150 */
+    "r",  "r",  "s",  "s",  "s",  "s",  "s",  "s",  /* U+0158 */
+    "s",  "s",  "t",  "t",  "t",  "t",  "t",  "t",  /* U+0160 */
+    "u",  "u",  "u",  "u",  "u",  "u",  "u",  "u",  /* U+0168 */
+    "u",  "u",  "u",  "u",  "w",  "w",  "y",  "y",  /* U+0170 */
+    "y",  "z",  "z",  "z",  "z",  "z",  "z",  "s",  /* U+0178 */
+};
+
+static inline const char *norm_mode_name(int mode) {
+    switch (mode) {
+        case NORM_UTF8: return "UTF-8";
+        case NORM_UTF8_STRIP: return "UTF-8 sem acentos";
+        default: return "ASCII";
+    }
+}
+
+/*
+ * Decodifica o caractere em p[0..avail) e devolve quantos bytes ele ocupa.
+ * Uma sequência inválida ou truncada vira um único caractere Latin-1.
+ */
+static inline size_t norm_decode(const unsigned char *p, size_t avail, unsigned *cp) {
+    unsigned b = p[0];
+    if (b >= 0xC2 && b <= 0xDF && avail >= 2 && (p[1] & 0xC0) == 0x80) {
+        *cp = ((b & 0x1F) << 6) | (p[1] & 0x3F);
+        return 2;
+    }
+    if (b >= 0xE0 && b <= 0xEF && avail >= 3 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+        *cp = ((b & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        if (*cp >= 0x800) return 3;
+    }
+    if (b >= 0xF0 && b <= 0xF4 && avail >= 4 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80 &&
+        (p[3] & 0xC0) == 0x80) {
+        *cp = ((b & 0x07) << 18) | ((p[1] & 0x3F) << 12) | ((p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+        if (*cp >= 0x10000) return 4;
+    }
+    *cp = b;
+    return 1;
+}
+
+/*
+ * Escreve em out a forma normalizada de word[0..len) e devolve seu tamanho
+ * (0 se a palavra não tem letras). out precisa de espaço para 2 * len bytes:
+ * um byte Latin-1 vira dois em UTF-8.
+ */
+static inline size_t norm_word(const char *word, size_t len, int mode, char *out) {
+    const unsigned char *p = (const unsigned char *)word;
+    size_t n = 0, i = 0;
+    while (i < len) {
+        unsigned cp = p[i];
+        if (cp < 0x80) {
+            if (NORM_FOLD[cp]) out[n++] = (char)NORM_FOLD[cp];
+            i++;
+            continue;
+        }
+        if (mode == NORM_ASCII) {
+            i++;
+            continue;
+        }
+        i += norm_decode(p + i, len - i, &cp);
+        if (cp >= NORM_TABLE_SIZE || !NORM_FOLD[cp]) continue;
+        if (mode == NORM_UTF8_STRIP && NORM_STRIP[cp][0]) {
+            out[n++] = NORM_STRIP[cp][0];
+            if (NORM_STRIP[cp][1]) out[n++] = NORM_STRIP[cp][1];
+            continue;
+        }
+        cp = NORM_FOLD[cp];
+        if (cp < 0x80) {
+            out[n++] = (char)cp;
+        } else {
+            out[n++] = (char)(0xC0 | (cp >> 6));
+            out[n++] = (char)(0x80 | (cp & 0x3F));
+        }
+    }
+    return n;
+}
+
+/* Diz se word[0..len) tem alguma letra, ou seja, se vira um token */
+static inline int norm_has_letter(const char *word, size_t len, int mode) {
+    const unsigned char *p = (const unsigned char *)word;
+    size_t i = 0;
+    while (i < len) {
+        unsigned cp = p[i];
+        if (cp < 0x80 || mode == NORM_ASCII) {
+            if (cp < 0x80 && NORM_FOLD[cp]) return 1;
+            i++;
+            continue;
+        }
+        i += norm_decode(p + i, len - i, &cp);
+        if (cp < NORM_TABLE_SIZE && NORM_FOLD[cp]) return 1;
+    }
+    return 0;
+}
+
+#endif
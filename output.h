@@ -0,0 +1,111 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/**
+ * Estágio de resultados: os n-gramas significativos como registros
+ * (contagem, texto), a ordem em que saem e a formatação em buffer.
+ *
+ * Formatos:
+ *   text:   a linha do ngrams.c, "'w1 ... wN' \t (Contagem: C, Frequência: F%)"
+ *   tsv:    "w1 ... wN\tC\tF" (F como fração do total, não porcentagem)
+ *   binary: cabeçalho [magic "NGRS"] [versão u8] [N u8] [2 bytes reservados] [u64 total]
+ *           e os registros [u32 contagem] [u32 tamanho do texto] [texto]
+ *   lookup: arquivo de consulta mapeável, em ordem de n-grama (ver lookup.h e
+ *           writeLookup em parallel.cpp)
+ *
+ * Os registros binários também são o formato de troca da ordenação
+ * distribuída (ver sortResults em parallel.cpp).
+ */
+
+enum ResultOrder { ORDER_NONE, ORDER_COUNT, ORDER_NGRAM };
+enum ResultFormat { FORMAT_TEXT, FORMAT_TSV, FORMAT_BINARY, FORMAT_LOOKUP };
+
+const char RESULT_MAGIC[4] = { 'N', 'G', 'R', 'S' };
+const uint8_t RESULT_VERSION = 1;
+const size_t RESULT_HEADER = 16;
+
+struct ResultEntry {
+    uint32_t count;
+    std::string text;
+};
+
+// Ordem de --sort count: contagem decrescente, depois texto; --sort ngram: só o texto
+inline bool result_before(const ResultEntry& a, const ResultEntry& b, int order) {
+    if (order == ORDER_COUNT && a.count != b.count) return a.count > b.count;
+    return a.text < b.text;
+}
+
+struct ResultLess {
+    int order;
+    bool operator()(const ResultEntry& a, const ResultEntry& b) const { return result_before(a, b, order); }
+};
+
+inline void append_u32(std::string& out, uint32_t v) { out.append((const char*)&v, sizeof(v)); }
+
+inline void append_record(std::string& out, const ResultEntry& e) {
+    append_u32(out, e.count);
+    append_u32(out, (uint32_t)e.text.length());
+    out += e.text;
+}
+
+// Lê os registros de buf[0, len) e os acrescenta a `out`; false se estiver truncado
+inline bool read_records(const char* buf, size_t len, std::vector<ResultEntry>& out) {
+    size_t pos = 0;
+    while (pos < len) {
+        if (len - pos < 8) return false;
+        ResultEntry e;
+        uint32_t text_len;
+        memcpy(&e.count, buf + pos, 4);
+        memcpy(&text_len, buf + pos + 4, 4);
+        pos += 8;
+        if (len - pos < text_len) return false;
+        e.text.assign(buf + pos, text_len);
+        pos += text_len;
+        out.push_back(e);
+    }
+    return true;
+}
+
+inline void append_binary_header(std::string& out, int N, uint64_t total) {
+    out.append(RESULT_MAGIC, 4);
+    out += (char)RESULT_VERSION;
+    out += (char)N;
+    out.append(2, '\0');
+    out.append((const char*)&total, sizeof(total));
+}
+
+/**
+ * Formata os registros [begin, end) em `out`, sem passar pelo iostream: um
+ * snprintf por linha num buffer que cresce por blocos.
+ */
+inline void format_results(const std::vector<ResultEntry>& entries, size_t begin, size_t end, int format,
+                           long long total, std::string& out) {
+    char line[96];
+    for (size_t i = begin; i < end; i++) {
+        const ResultEntry& e = entries[i];
+        double freq = (total > 0) ? (double)e.count / total : 0.0;
+        switch (format) {
+            case FORMAT_BINARY:
+                append_record(out, e);
+                break;
+            case FORMAT_TSV:
+                out += e.text;
+                out.append(line, snprintf(line, sizeof(line), "\t%u\t%.8g\n", e.count, freq));
+                break;
+            default:
+                out += '\'';
+                out += e.text;
+                out.append(line, snprintf(line, sizeof(line), "' \t (Contagem: %u, Frequência: %.4f%%)\n", e.count,
+                                          freq * 100.0));
+        }
+    }
+}
+
+#endif
@@ -2,368 +2,2038 @@
 #include <iostream>
 #include <vector>
 #include <string>
-// map não é mais necessário se printNgrams for corrigido
+#include <string_view>
+#include <cassert>
 #include <cctype>
+#include <climits>
 #include <fstream>
-#include <sstream>
-#include <unordered_map>
 #include <cstring>
+#include <cstdlib>
 #include <algorithm> // Para std::max
+#include <iomanip>
+#include <utility>
+#include <unordered_map>
+#include <stdint.h>
+#include <unistd.h>
+#include "config.h"
+#include "instrument.h"
+#include "lookup.h"
+#include "mapped_file.h"
+#include "ngram_table.h"
+#include "ngram_wire.h"
+#include "node_table.h"
+#include "output.h"
+#include "radix_sort.h"
+#include "sketch.h"
+#include "snapshot.h"
+#include "spill.h"
+#include "tokenizer.h"
+#include "work_pool.h"
+
+// Tamanhos de n-grama, limiar, entradas e os modos de leitura e de redução
+// são escolhidos na execução: ver config.h e `parallel --help`.
+//
+// Leitura (--read):
+// tree: o Rank 0 lê o arquivo e distribui o texto pela árvore (modo original)
+// ranges: cada processo lê sua própria faixa de bytes com MPI-IO (sem fase de distribuição)
+// blocks: o arquivo é cortado em blocos de --block-size bytes e cada processo pega o
+//         próximo bloco livre de um contador compartilhado até acabarem (balanceamento
+//         dinâmico), lendo cada bloco com MPI-IO
+//
+// Redução (--reduce):
+// tree: cada nó recebe os mapas dos filhos (2r+1, 2r+2) e envia ao pai; a raiz fica com tudo
+// shuffle: os n-gramas são particionados por hash entre todos os processos com
+//          MPI_Alltoallv; cada processo fica dono de uma fatia disjunta do resultado
+// sketch: aproximado; só resumos de tamanho fixo (Count-Min + Space-Saving) são
+//         reduzidos, e a raiz recebe apenas os n-gramas candidatos a frequentes.
+//         O Count-Min erra no máximo --sketch-epsilon * total com probabilidade
+//         1 - --sketch-delta; o resumo guarda os --sketch-top-k mais frequentes.
+//         Com --sketch-verify 1, os candidatos são impressos com a contagem exata
+//         (somada das tabelas locais) em vez da estimativa, e os que não atingem o
+//         limiar saem.
+// node: em dois níveis; os processos de cada nó (MPI_COMM_TYPE_SHARED) somam as
+//       contagens numa tabela em memória compartilhada (MPI_Win_allocate_shared),
+//       sem serializar nada, e só um líder por nó segue na árvore entre os nós
+//
+// --prefilter: antes de tree/shuffle/node, um filtro em duas fases descarta as
+// entradas que não podem atingir o limiar no total; o resultado impresso
+// continua exato, mas o número de n-gramas únicos deixa de ser conhecido.
+//
+// Com vários N (--n 1-6), o texto é lido e tokenizado uma vez e cada N tem a
+// sua tabela; a redução é feita para um N de cada vez.
+
+// Tamanho do filtro: PREFILTER_ROWS linhas, cada uma com PREFILTER_COUNTERS
+// contadores por entrada local (somadas as de todos os processos), e no
+// máximo PREFILTER_MAX_BYTES no total. O sketch vai a todos os processos, então
+// precisa ser bem menor que as entradas que ele evita enviar.
+const int PREFILTER_ROWS = 2;
+const size_t PREFILTER_COUNTERS = 1;
+const size_t PREFILTER_MAX_BYTES = 16 << 20;
 
-#define DEBUG 1   
-#define N_GRAM_SIZE 5      // Tamanho do n-grama
-#define MIN_THRESHOLD 2    // Limiar mínimo para exibir
+// Quantos bytes além da faixa própria cada leitura MPI-IO traz de uma vez
+// ao procurar o fim da última palavra e os (N-1) tokens seguintes.
+const size_t READ_AHEAD_CHARS = 4096;
 
-// --- CONSTANTES DA NOVA LÓGICA ---
-// Novo "delta", baseado em contagem de caracteres, não tokens.
-// Se um nó recebe um bloco de texto menor que isso, ele conquista.
-const size_t CHAR_THRESHOLD = 100000; // 100KB
+// Com --memory, cada processo lê sua faixa em janelas de 1/16 do orçamento
+// (no mínimo MIN_WINDOW_CHARS), gravando runs em disco quando a tabela enche.
+const size_t MIN_WINDOW_CHARS = 64 * 1024;
 
-// Overlap em caracteres. Deve ser grande o suficiente para
-// capturar (N-1) tokens. 4KB é um palpite seguro.
-const size_t OVERLAP_CHARS = 4096; 
+// Com --threads > 1, o texto de cada processo é cortado em até
+// TASKS_PER_THREAD pedaços por thread, nenhum menor que MIN_TASK_CHARS.
+const int TASKS_PER_THREAD = 4;
+const size_t MIN_TASK_CHARS = 64 * 1024;
 
 using namespace std;
 
-// --- Funções Auxiliares (Sem alteração) ---
+// Configuração desta execução, lida em main() (ver config.h)
+Config config;
 
-string read_file_to_string(const char *path) {
-    ifstream file(path);
-    if (!file.is_open()) {
-        cerr << "Erro ao abrir arquivo: " << path << endl;
-        return "";
+// --- Funções Auxiliares ---
+
+// O arquivo inteiro, mapeado em memória (ou lido, com --mmap 0 ou se não der para mapear)
+bool openInput(const char *path, MappedFile& input) {
+    PhaseTimer timer(PH_READ);
+    if (mapped_file_open(&input, path, config.use_mmap) != 0) {
+        cerr << "Erro ao abrir arquivo: " << path << " (" << strerror(errno) << ")" << endl;
+        return false;
     }
-    stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
+    profile.count(CT_BYTES_READ, input.size);
+    return true;
 }
 
-vector<string> tokenize_optimized(const string& text) {
-    vector<string> tokens;
-    string current_word;
-    tokens.reserve(text.length() / 5); 
+// Versão do tokenizador (escalar, SSE2 ou AVX2) escolhida conforme a CPU; ver tokenizer.h
+const TokenizerKind TOKENIZER = best_tokenizer();
 
-    for (char c : text) {
-        if (isalpha(c)) {
-            current_word += tolower(c);
-        } else if (!current_word.empty()) {
-            tokens.push_back(current_word);
-            current_word.clear();
-        }
+// --- Funções de N-gram ---
+
+/**
+ * Conta os n-gramas inteiramente contidos em tokens[start_index, end_index).
+ * O hash de cada janela é obtido do anterior em O(1): remove-se a palavra que
+ * sai e acrescenta-se a que entra. FIXED_N é N conhecido na compilação, ou 0
+ * (ver with_fixed_n).
+ */
+template <int FIXED_N>
+void countWindows(const vector<uint32_t>& tokens, const Vocabulary& vocab, int N, size_t start_index, size_t end_index, NgramTable& ngramCounts) {
+    const int n = FIXED_N > 0 ? FIXED_N : N;
+    uint64_t top_power = 1; // NGRAM_HASH_BASE^(n-1)
+    for (int j = 1; j < n; j++) top_power *= NGRAM_HASH_BASE;
+
+    uint64_t h = 0;
+    for (int j = 0; j < n; j++) {
+        h = h * NGRAM_HASH_BASE + vocab.word_hash(tokens[start_index + j]);
     }
-    if (!current_word.empty()) {
-        tokens.push_back(current_word);
+    for (size_t i = start_index; ; i++) {
+        ngramCounts.add<FIXED_N>(&tokens[i], h, 1);
+        if (i + n >= end_index) break;
+        h = (h - vocab.word_hash(tokens[i]) * top_power) * NGRAM_HASH_BASE + vocab.word_hash(tokens[i + n]);
     }
-    return tokens;
 }
 
-// --- Funções de N-gram (Sem alteração) ---
+// countWindows instanciado para o N da tabela
+void generateAndCountNgrams(const vector<uint32_t>& tokens, const Vocabulary& vocab, int N, size_t start_index, size_t end_index, NgramTable& ngramCounts) {
+    if (end_index > tokens.size() || end_index < start_index + N) return;
+    with_fixed_n(N, [&](auto fixed) {
+        countWindows<decltype(fixed)::value>(tokens, vocab, N, start_index, end_index, ngramCounts);
+    });
+}
+
+/**
+ * O mesmo que generateAndCountNgrams, por ordenação (--engine sort): os
+ * n-gramas viram chaves de largura fixa (radix_sort.h), ordenadas por radix
+ * sort, e cada n-grama distinto entra na tabela uma só vez, com a contagem
+ * da sua sequência. Troca uma inserção na tabela por n-grama por duas
+ * passadas lineares por dígito, o que compensa em textos muito repetitivos.
+ */
+void sortAndCountNgrams(const vector<uint32_t>& tokens, const Vocabulary& vocab, int N, size_t start_index, size_t end_index, NgramTable& ngramCounts) {
+    if (end_index > tokens.size() || end_index < start_index + N) return;
+
+    size_t n = end_index - start_index - N + 1;
+    int bits = radix_id_bits(vocab.size());
+    int words = radix_key_words(N, bits);
+    vector<uint64_t> keys(n * words), tmp(n * words);
+    for (size_t i = 0; i < n; i++) radix_pack(&keys[i * words], words, &tokens[start_index + i], N, bits);
+    const uint64_t* sorted = radix_sort_keys(&keys[0], &tmp[0], n, words, N * bits, 1);
 
-unordered_map<string, int> generateAndCountNgrams(const vector<string>& tokens, int N, size_t start_index, size_t end_index) {
-    unordered_map<string, int> ngramCounts;
-    
-    if (tokens.empty() || end_index <= start_index || end_index > tokens.size()) {
-         return ngramCounts;
+    vector<uint32_t> ids(N);
+    size_t run_start = 0;
+    for (size_t i = 1; i <= n; i++) {
+        if (i < n && radix_key_equal(&sorted[i * words], &sorted[run_start * words], words)) continue;
+        radix_unpack(&sorted[run_start * words], words, &ids[0], N, bits);
+        uint64_t h = 0;
+        for (int j = 0; j < N; j++) h = h * NGRAM_HASH_BASE + vocab.word_hash(ids[j]);
+        ngramCounts.add(&ids[0], h, i - run_start);
+        run_start = i;
     }
+}
 
-    size_t last_start_index = (end_index >= (size_t)(N - 1)) ? end_index - (N - 1) : 0;
-    if (last_start_index < start_index) return ngramCounts;
+/**
+ * Conta os n-gramas que começam nos primeiros owned_chars bytes do texto,
+ * para cada N do conjunto. O restante do texto é o lookahead: os (N-1)
+ * tokens que completam os últimos n-gramas da faixa, que pertencem ao vizinho
+ * e não são contados aqui (o texto traz o lookahead do maior N).
+ */
+void countOwnedNgrams(string_view text, size_t owned_chars, NgramCountSet& ngramCounts) {
+    size_t owned_tokens;
+    PhaseTimer tokenize_timer(PH_TOKENIZE);
+    vector<uint32_t> tokens = tokenize_optimized(text, ngramCounts.vocab, TOKENIZER, config.normalization, owned_chars, &owned_tokens);
+    tokenize_timer.stop();
+    profile.count(CT_TOKENS, owned_tokens);
+    if (owned_tokens == 0) return;
 
-    for (size_t i = start_index; i <= last_start_index; i++) {
-        if (i + N > tokens.size()) break; 
-        string ngram = tokens[i];
-        for (int j = 1; j < N; j++) {
-            ngram += " " + tokens[i + j];
+    PhaseTimer count_timer(PH_COUNT);
+    for (size_t i = 0; i < ngramCounts.tables.size(); i++) {
+        int N = ngramCounts.tables[i].n();
+        size_t end_index = min(tokens.size(), owned_tokens + N - 1);
+        if (config.engine == ENGINE_SORT) {
+            sortAndCountNgrams(tokens, ngramCounts.vocab, N, 0, end_index, ngramCounts.tables[i]);
+        } else {
+            generateAndCountNgrams(tokens, ngramCounts.vocab, N, 0, end_index, ngramCounts.tables[i]);
         }
-        ngramCounts[ngram]++;
     }
-    return ngramCounts;
 }
 
-void mergeNgramMaps(unordered_map<string, int>& dest, const unordered_map<string, int>& src) {
-    for (const auto& pair : src) {
-        dest[pair.first] += pair.second;
+/**
+ * Versão multithread: a parte própria do texto é cortada em pedaços, em
+ * quebras de palavra, e cada pedaço (com os N-1 tokens que o seguem) vira uma
+ * tarefa do WorkStealingPool. Cada thread conta no seu próprio conjunto e os
+ * conjuntos são juntados por uma redução em árvore, também em paralelo.
+ */
+void countOwnedNgrams(string_view text, size_t owned_chars, NgramCountSet& ngramCounts, int num_threads) {
+    size_t num_tasks = min((size_t)num_threads * TASKS_PER_THREAD, owned_chars / MIN_TASK_CHARS);
+    if (num_threads <= 1 || num_tasks <= 1) {
+        countOwnedNgrams(text, owned_chars, ngramCounts);
+        return;
+    }
+
+    vector<size_t> cuts(num_tasks + 1, 0);
+    cuts[num_tasks] = owned_chars;
+    for (size_t k = 1; k < num_tasks; k++) {
+        size_t cut = max(owned_chars * k / num_tasks, cuts[k - 1]);
+        while (cut < owned_chars && !is_separator(text[cut])) cut++;
+        cuts[k] = cut;
+    }
+
+    WorkStealingPool pool(num_threads);
+    vector<NgramCountSet> partial;
+    partial.reserve(pool.size());
+    for (int t = 0; t < pool.size(); t++) partial.push_back(NgramCountSet(config.ns));
+    int lookahead_tokens = config.max_n() - 1;
+
+    pool.run(num_tasks, [&](int thread, size_t task) {
+        size_t begin = cuts[task], end = cuts[task + 1];
+        if (begin == end) return;
+        Profile::set_thread(thread);
+        size_t lookahead_end = find_lookahead_end(text, end, lookahead_tokens, true, config.normalization);
+        countOwnedNgrams(text.substr(begin, lookahead_end - begin), end - begin, partial[thread]);
+    });
+    PhaseTimer merge_timer(PH_LOCAL_MERGE);
+    WorkStealingPool::reduce<NgramCountSet>(partial, [](NgramCountSet& dest, NgramCountSet& src) {
+        dest.merge(src);
+        src.clear(); // Libera a memória assim que possível
+    });
+
+    if (ngramCounts.empty()) {
+        ngramCounts = std::move(partial[0]);
+    } else {
+        ngramCounts.merge(partial[0]);
     }
 }
 
-// Corrigido para aceitar unordered_map
-void printNgrams(const unordered_map<string, int>& ngrams, int min_threshold) {
+long long countTotalNgrams(const NgramCounts& ngrams) {
     long long total_ngrams = 0; // Usar long long para contagens grandes
-    for (const auto& pair : ngrams) {
-        total_ngrams += pair.second;
+    for (size_t e = 0; e < ngrams.table.size(); e++) {
+        total_ngrams += ngrams.table.count(e);
+    }
+    return total_ngrams;
+}
+
+long long countSignificantNgrams(const NgramCounts& ngrams, int min_threshold) {
+    long long significant = 0;
+    for (size_t e = 0; e < ngrams.table.size(); e++) {
+        if (ngrams.table.count(e) >= (uint32_t)min_threshold) significant++;
     }
-    
-    cout << "\n--- N-gramas Significativos (Limiar: " << min_threshold << ") ---\n";
-    for (const auto& pair : ngrams) {
-        if (pair.second >= min_threshold) {
-            double relative_freq = (total_ngrams > 0) ? (double)pair.second / total_ngrams : 0.0;
-            cout << "'" << pair.first << "' \t (Contagem: " << pair.second 
-                 << ", Frequência: " << (relative_freq * 100.0) << "%)\n";
+    return significant;
+}
+
+// Se os n-gramas significativos vão para algum lugar (--print ou --output)
+bool wantResults() {
+    return config.print_ngrams || !config.output_path.empty();
+}
+
+/**
+ * Acrescenta a `results` os n-gramas com contagem >= limiar desta tabela, já
+ * como texto, para o estágio de resultados (emitResults).
+ */
+void collectSignificant(const NgramCounts& ngrams, vector<ResultEntry>& results) {
+    PhaseTimer timer(PH_OUTPUT);
+    const NgramTable& table = ngrams.table;
+    for (size_t e = 0; e < table.size(); e++) {
+        if (table.count(e) >= (uint32_t)config.min_threshold) {
+            results.push_back(ResultEntry());
+            results.back().count = table.count(e);
+            ngrams.ngram_text(e, results.back().text);
         }
     }
 }
 
-// --- NOVAS Funções de Comunicação (Strings) ---
+// Cabeçalho da listagem; com um só N, igual ao do ngrams.c
+void printNgramsHeader(int N) {
+    cout << "\n--- N-gramas Significativos (";
+    if (config.ns.size() > 1) cout << "N = " << N << ", ";
+    cout << "Limiar: " << config.min_threshold << ") ---\n";
+}
+
+// --- Funções de Comunicação (Texto) ---
+
+// Tags das mensagens: texto descendo pela árvore e contagens subindo. As
+// contagens do i-ésimo N usam TAG_MAP + i, para que um filho que já passou
+// ao N seguinte não tenha a sua mensagem confundida com a do N atual.
+const int TAG_TEXT = 1;
+const int TAG_MAP = 2;
 
 /**
- * Envia uma std::string de forma eficiente.
- * Formato: [size_t len] [char* data]
+ * Tipo MPI de `len` bytes contíguos, a partir do deslocamento `base` (0, ou um
+ * endereço absoluto para usar com MPI_BOTTOM). As contagens do MPI são int,
+ * então trechos acima de INT_MAX bytes são descritos em blocos de
+ * MESSAGE_CHUNK bytes mais um resto. O tipo devolvido já está commitado.
  */
-void sendOptimizedString(const string& text, int dest) {
-    size_t len = text.length();
-    // Envia o tamanho
-    MPI_Send(&len, 1, MPI_UNSIGNED_LONG, dest, 0, MPI_COMM_WORLD);
-    // Envia os dados da string
-    MPI_Send(text.c_str(), len, MPI_CHAR, dest, 0, MPI_COMM_WORLD);
+const size_t MESSAGE_CHUNK = (size_t)1 << 30;
+
+MPI_Datatype bytesType(size_t len, MPI_Aint base = 0) {
+    size_t chunks = len / MESSAGE_CHUNK;
+    assert(chunks <= (size_t)INT_MAX);
+    MPI_Datatype chunk, type;
+    MPI_Type_contiguous((int)MESSAGE_CHUNK, MPI_BYTE, &chunk);
+    int block_lengths[2] = { (int)chunks, (int)(len % MESSAGE_CHUNK) };
+    MPI_Aint displacements[2] = { base, base + (MPI_Aint)(chunks * MESSAGE_CHUNK) };
+    MPI_Datatype types[2] = { chunk, MPI_BYTE };
+    MPI_Type_create_struct(2, block_lengths, displacements, types, &type);
+    MPI_Type_commit(&type);
+    MPI_Type_free(&chunk);
+    return type;
+}
+
+// Envio bloqueante de buf[0, len), de qualquer tamanho
+void sendBytes(const char* buf, size_t len, int dest, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Datatype type = bytesType(len);
+    MPI_Send(buf, 1, type, dest, tag, comm);
+    MPI_Type_free(&type);
+}
+
+// Bytes da mensagem de `status` (MPI_Get_count devolveria int)
+size_t messageBytes(const MPI_Status& status) {
+    MPI_Count len;
+    MPI_Get_elements_x(&status, MPI_BYTE, &len);
+    return len;
+}
+
+// Posições de cada parte de um buffer com as partes em sequência; a última é o total
+vector<size_t> offsetsOf(const vector<size_t>& bytes) {
+    vector<size_t> offsets(bytes.size() + 1, 0);
+    for (size_t p = 0; p < bytes.size(); p++) offsets[p + 1] = offsets[p] + bytes[p];
+    return offsets;
+}
+
+/**
+ * Alltoallv com tamanhos size_t: send tem, em sequência, send_bytes[p] bytes
+ * para cada processo p, e recv recebe recv_bytes[p] de cada um, também em
+ * sequência. O MPI_Alltoallv tem contagens e deslocamentos int; aqui cada
+ * parte vira um tipo de bytesType com o seu endereço absoluto, num
+ * MPI_Alltoallw sobre MPI_BOTTOM. Com tamanhos zero para quase todos os pares,
+ * serve também de Gatherv.
+ */
+static_assert(sizeof(size_t) == sizeof(uint64_t), "os tamanhos vão como MPI_UINT64_T");
+
+void exchangeBytes(const char* send, const vector<size_t>& send_bytes, char* recv, const vector<size_t>& recv_bytes,
+                   MPI_Comm comm = MPI_COMM_WORLD) {
+    int nprocs = send_bytes.size();
+    vector<size_t> send_off = offsetsOf(send_bytes), recv_off = offsetsOf(recv_bytes);
+    vector<int> ones(nprocs, 1), zeros(nprocs, 0);
+    vector<MPI_Datatype> send_types(nprocs), recv_types(nprocs);
+    for (int p = 0; p < nprocs; p++) {
+        MPI_Aint address;
+        MPI_Get_address(send + send_off[p], &address);
+        send_types[p] = bytesType(send_bytes[p], address);
+        MPI_Get_address(recv + recv_off[p], &address);
+        recv_types[p] = bytesType(recv_bytes[p], address);
+    }
+    MPI_Alltoallw(MPI_BOTTOM, &ones[0], &zeros[0], &send_types[0], MPI_BOTTOM, &ones[0], &zeros[0], &recv_types[0], comm);
+    for (int p = 0; p < nprocs; p++) {
+        MPI_Type_free(&send_types[p]);
+        MPI_Type_free(&recv_types[p]);
+    }
 }
 
 /**
- * Recebe uma std::string de forma eficiente.
+ * Gatherv de tamanhos size_t: a raiz recebe em `recv` o `send` de cada
+ * processo, em ordem de rank, com os tamanhos em recv_bytes e as posições em
+ * recv_off (o total no fim). `recv` tem um byte a mais, para nunca ser vazio.
  */
-string receiveOptimizedString(int source) {
+void gatherBytes(const string& send, int root, vector<char>& recv, vector<size_t>& recv_bytes,
+                 vector<size_t>& recv_off, MPI_Comm comm = MPI_COMM_WORLD) {
+    int my_rank, nprocs;
+    MPI_Comm_rank(comm, &my_rank);
+    MPI_Comm_size(comm, &nprocs);
+    size_t len = send.length();
+    recv_bytes.assign(nprocs, 0);
+    MPI_Gather(&len, 1, MPI_UINT64_T, &recv_bytes[0], 1, MPI_UINT64_T, root, comm);
+    recv_off = offsetsOf(recv_bytes);
+    recv.resize(recv_off[nprocs] + 1);
+    vector<size_t> send_bytes(nprocs, 0);
+    send_bytes[root] = len;
+    exchangeBytes(send.data(), send_bytes, &recv[0], recv_bytes, comm);
+}
+
+/**
+ * Envio não bloqueante de um bloco de texto.
+ * Formato: [size_t owned_chars] [texto], numa única mensagem: um tipo derivado
+ * junta o cabeçalho e o trecho do texto sem copiá-los para outro buffer.
+ * O texto e o TextSend precisam continuar vivos até waitText().
+ */
+struct TextSend {
+    size_t owned_chars;
+    MPI_Datatype type;
+    MPI_Request request;
+};
+
+void sendOptimizedString(const char* text, size_t len, size_t owned_chars, int dest, TextSend& send) {
+    send.owned_chars = owned_chars;
+    MPI_Datatype text_type = bytesType(len);
+    int block_lengths[2] = { (int)sizeof(size_t), 1 };
+    MPI_Aint displacements[2];
+    MPI_Get_address(&send.owned_chars, &displacements[0]);
+    MPI_Get_address(text, &displacements[1]);
+    MPI_Datatype types[2] = { MPI_BYTE, text_type };
+    MPI_Type_create_struct(2, block_lengths, displacements, types, &send.type);
+    MPI_Type_commit(&send.type);
+    MPI_Type_free(&text_type);
+    MPI_Isend(MPI_BOTTOM, 1, send.type, dest, TAG_TEXT, MPI_COMM_WORLD, &send.request);
+    profile.count(CT_MESSAGES_SENT, 1);
+    profile.count(CT_BYTES_SENT, sizeof(size_t) + len);
+}
+
+void waitText(TextSend& send) {
+    PhaseTimer timer(PH_SEND);
+    MPI_Wait(&send.request, MPI_STATUS_IGNORE);
+    MPI_Type_free(&send.type);
+}
+
+/**
+ * Recebe um bloco de texto direto em `buffer`, que é alocado uma vez com o
+ * tamanho exato da mensagem (MPI_Mprobe + MPI_Get_elements_x, que conta
+ * acima de INT_MAX). Devolve uma view do texto dentro do buffer, depois do
+ * cabeçalho, sem nenhuma cópia.
+ */
+string_view receiveOptimizedString(int source, string& buffer, size_t& owned_chars) {
+    MPI_Message message;
     MPI_Status status;
-    size_t len;
-    
-    // Recebe o tamanho
-    MPI_Recv(&len, 1, MPI_UNSIGNED_LONG, source, 0, MPI_COMM_WORLD, &status);
-    
-    // Aloca buffer ( +1 para o terminador nulo)
-    char* buffer = new char[len + 1];
-    
-    // Recebe os dados
-    MPI_Recv(buffer, len, MPI_CHAR, source, 0, MPI_COMM_WORLD, &status);
-    
-    // Adiciona terminador nulo e cria a string
-    buffer[len] = '\0';
-    string text(buffer);
-    
-    delete[] buffer;
-    return text;
-}
-
-
-// --- Funções de Comunicação (Mapas) - Sem alteração ---
-
-void sendOptimizedMap(const unordered_map<string, int>& ngrams, int dest) {
-    int num_pairs = ngrams.size();
-    if (num_pairs == 0) {
-        size_t str_buffer_size = 0;
-        MPI_Send(&num_pairs, 1, MPI_INT, dest, 0, MPI_COMM_WORLD);
-        MPI_Send(&str_buffer_size, 1, MPI_UNSIGNED_LONG, dest, 0, MPI_COMM_WORLD);
+    PhaseTimer timer(PH_RECEIVE);
+    MPI_Mprobe(source, TAG_TEXT, MPI_COMM_WORLD, &message, &status);
+    size_t len = messageBytes(status);
+
+    buffer.resize(len);
+    MPI_Datatype type = bytesType(len);
+    MPI_Mrecv(&buffer[0], 1, type, &message, MPI_STATUS_IGNORE);
+    MPI_Type_free(&type);
+    profile.count(CT_MESSAGES_RECEIVED, 1);
+    profile.count(CT_BYTES_RECEIVED, len);
+    memcpy(&owned_chars, buffer.data(), sizeof(size_t));
+    return string_view(buffer).substr(sizeof(size_t));
+}
+
+
+// --- Funções de Comunicação (Mapas) ---
+
+/**
+ * Envia a contagem numa única mensagem no formato de ngram_wire.h.
+ */
+void sendOptimizedMap(const NgramCounts& ngrams, int dest, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    string buffer;
+    PhaseTimer serialize_timer(PH_SERIALIZE);
+    serializeNgrams(ngrams, NULL, buffer);
+    serialize_timer.stop();
+
+    PhaseTimer send_timer(PH_SEND);
+    sendBytes(buffer.data(), buffer.length(), dest, tag, comm);
+    profile.count(CT_MESSAGES_SENT, 1);
+    profile.count(CT_BYTES_SENT, buffer.length());
+}
+
+/**
+ * Recebe as contagens de `num_sources` processos, em qualquer ordem, e as
+ * soma em `dest`. Cada mensagem anunciada já tem seu receive postado
+ * (MPI_Imrecv) enquanto as que chegaram antes são mescladas, então um
+ * remetente lento não atrasa o merge dos outros. As esperas bloqueiam
+ * (MPI_Mprobe, MPI_Waitany), sem ocupar um núcleo com sondagens.
+ */
+void receiveOptimizedMaps(int num_sources, int tag, NgramCounts& dest, MPI_Comm comm = MPI_COMM_WORLD) {
+    vector<vector<char> > buffers(num_sources);
+    vector<MPI_Request> requests(num_sources, MPI_REQUEST_NULL);
+    vector<int> sources(num_sources);
+    int posted = 0, merged = 0;
+
+    // Tempo de espera: tudo menos os merges
+    PhaseTimer waiting(PH_RECEIVE);
+    while (merged < num_sources) {
+        // Posta o receive de toda mensagem que já foi anunciada
+        while (posted < num_sources) {
+            MPI_Message message;
+            MPI_Status status;
+            int found = 0;
+            if (posted == merged) {
+                // Nada pendente: pode bloquear até a próxima chegar
+                MPI_Mprobe(MPI_ANY_SOURCE, tag, comm, &message, &status);
+                found = 1;
+            } else {
+                MPI_Improbe(MPI_ANY_SOURCE, tag, comm, &found, &message, &status);
+            }
+            if (!found) break;
+            size_t len = messageBytes(status);
+            buffers[posted].resize(len);
+            sources[posted] = status.MPI_SOURCE;
+            MPI_Datatype type = bytesType(len);
+            MPI_Imrecv(buffers[posted].data(), 1, type, &message, &requests[posted]);
+            MPI_Type_free(&type); // O receive pendente continua válido
+            posted++;
+        }
+
+        // Bloqueia até um receive postado terminar; as mensagens que chegarem
+        // enquanto isso são postadas na próxima volta, antes do merge seguinte
+        int index;
+        MPI_Waitany(num_sources, &requests[0], &index, MPI_STATUS_IGNORE);
+
+        waiting.stop();
+        profile.count(CT_MESSAGES_RECEIVED, 1);
+        profile.count(CT_BYTES_RECEIVED, buffers[index].size());
+        PhaseTimer merge_timer(PH_RECEIVED_MERGE);
+        if (!mergeSerializedNgrams(buffers[index].data(), buffers[index].size(), dest)) {
+            cerr << "Mensagem de n-gramas inválida recebida de " << sources[index] << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        vector<char>().swap(buffers[index]);
+        merged++;
+        merge_timer.stop();
+        waiting.restart();
+    }
+}
+
+// --- Leitura Paralela (MPI-IO) ---
+
+void readFileAt(MPI_File fh, MPI_Offset offset, char* buffer, size_t len) {
+    // MPI_File_read_at recebe um int; lê em blocos para faixas > 2GB
+    const size_t max_block = 1 << 30;
+    PhaseTimer timer(PH_READ);
+    profile.count(CT_BYTES_READ, len);
+    while (len > 0) {
+        int block = (int)min(len, max_block);
+        MPI_Status status;
+        MPI_File_read_at(fh, offset, buffer, block, MPI_CHAR, &status);
+        offset += block;
+        buffer += block;
+        len -= block;
+    }
+}
+
+/**
+ * Descarta de text (que começa em begin - 1, ou em 0) a palavra que cruza
+ * `begin`, que pertence ao vizinho da esquerda. Em owned_chars retorna
+ * quantos bytes da view devolvida pertencem à faixa, que termina em
+ * range_end (relativo ao início de text).
+ */
+string_view skipPartialWord(string_view text, MPI_Offset begin, size_t range_end, size_t& owned_chars) {
+    size_t skip = 0;
+    if (begin > 0) {
+        skip = 1;
+        while (skip < text.length() && !is_separator(text[skip - 1]) && !is_separator(text[skip])) skip++;
+    }
+    owned_chars = (range_end > skip) ? range_end - skip : 0;
+    return text.substr(skip);
+}
+
+/**
+ * Lê diretamente do arquivo a faixa [begin, end) deste processo.
+ * A palavra que cruza `begin` pertence ao vizinho da esquerda e é descartada;
+ * a leitura continua além de `end` até fechar a última palavra e obter os
+ * (N-1) tokens seguintes, necessários para os últimos n-gramas da faixa.
+ * O texto fica em `text`; a view devolvida começa depois da palavra descartada.
+ * Em owned_chars retorna quantos bytes da view pertencem à faixa.
+ */
+string_view readOwnRange(MPI_File fh, MPI_Offset file_size, MPI_Offset begin, MPI_Offset end, int N, string& text, size_t& owned_chars) {
+    // Um byte antes de begin para saber se a faixa começa no meio de uma palavra
+    MPI_Offset read_start = (begin > 0) ? begin - 1 : 0;
+    MPI_Offset read_end = min(file_size, end + (MPI_Offset)READ_AHEAD_CHARS);
+
+    text.assign(read_end - read_start, '\0');
+    readFileAt(fh, read_start, &text[0], text.length());
+
+    size_t range_end = end - read_start;
+    while (find_lookahead_end(text, range_end, N - 1, read_end == file_size, config.normalization) == string::npos) {
+        MPI_Offset next_end = min(file_size, read_end + (MPI_Offset)READ_AHEAD_CHARS);
+        size_t old_len = text.length();
+        text.resize(old_len + (next_end - read_end));
+        readFileAt(fh, read_end, &text[old_len], next_end - read_end);
+        read_end = next_end;
+    }
+    size_t lookahead_end = find_lookahead_end(text, range_end, N - 1, read_end == file_size, config.normalization);
+    text.resize(lookahead_end);
+    return skipPartialWord(text, begin, range_end, owned_chars);
+}
+
+/**
+ * O mesmo que readOwnRange, sobre o arquivo mapeado: nada é lido nem
+ * copiado, a view aponta direto para as páginas do arquivo.
+ */
+string_view viewOwnRange(const MappedFile& input, MPI_Offset begin, MPI_Offset end, int N, size_t& owned_chars) {
+    MPI_Offset read_start = (begin > 0) ? begin - 1 : 0;
+    string_view text = string_view(input.data, input.size).substr(read_start);
+    size_t range_end = end - read_start;
+    text = text.substr(0, find_lookahead_end(text, range_end, N - 1, true, config.normalization));
+    profile.count(CT_BYTES_READ, range_end);
+    return skipPartialWord(text, begin, range_end, owned_chars);
+}
+
+/**
+ * Arquivo de entrada de --read ranges e --read blocks: mapeado em todos os
+ * processos ou, se algum não conseguir mapear (ou com --mmap 0), aberto com
+ * MPI-IO em todos, já que MPI_File_open é coletiva.
+ */
+struct RangeInput {
+    MappedFile mapped;
+    MPI_File fh;
+    MPI_Offset size;
+};
+
+void openRangeInput(const char* path, int my_rank, RangeInput& input) {
+    // Um arquivo vazio "mapeia" sem erro mas com kind MAPPED_NONE; segue por MPI-IO
+    input.fh = MPI_FILE_NULL;
+    int mapped = config.use_mmap && mapped_file_map(&input.mapped, path) == 0 && input.mapped.kind == MAPPED_MMAP;
+    int all_mapped;
+    MPI_Allreduce(&mapped, &all_mapped, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (all_mapped) {
+        input.size = input.mapped.size;
         return;
     }
-    
-    size_t str_buffer_size = 0;
-    for (const auto& pair : ngrams) {
-        str_buffer_size += pair.first.length() + 1;
+    if (mapped) mapped_file_close(&input.mapped);
+    input.mapped.kind = MAPPED_NONE;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &input.fh) != MPI_SUCCESS) {
+        if (my_rank == 0) cerr << "Erro ao abrir arquivo: " << path << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    MPI_File_get_size(input.fh, &input.size);
+}
 
-    char* str_buffer = new char[str_buffer_size];
-    int* counts_buffer = new int[num_pairs];
-    
-    size_t str_offset = 0;
-    int count_idx = 0;
-    for (const auto& pair : ngrams) {
-        memcpy(str_buffer + str_offset, pair.first.c_str(), pair.first.length() + 1);
-        str_offset += pair.first.length() + 1;
-        counts_buffer[count_idx++] = pair.second;
+// A faixa [begin, end) com o lookahead, do mapeamento ou lida para `buffer`
+string_view rangeText(RangeInput& input, MPI_Offset begin, MPI_Offset end, string& buffer, size_t& owned_chars) {
+    if (input.mapped.kind == MAPPED_MMAP) return viewOwnRange(input.mapped, begin, end, config.max_n(), owned_chars);
+    return readOwnRange(input.fh, input.size, begin, end, config.max_n(), buffer, owned_chars);
+}
+
+void closeRangeInput(RangeInput& input) {
+    if (input.mapped.kind == MAPPED_MMAP) {
+        mapped_file_close(&input.mapped);
+    } else if (input.fh != MPI_FILE_NULL) {
+        MPI_File_close(&input.fh);
     }
+}
 
-    MPI_Send(&num_pairs, 1, MPI_INT, dest, 0, MPI_COMM_WORLD);
-    MPI_Send(&str_buffer_size, 1, MPI_UNSIGNED_LONG, dest, 0, MPI_COMM_WORLD);
-    MPI_Send(str_buffer, str_buffer_size, MPI_CHAR, dest, 0, MPI_COMM_WORLD);
-    MPI_Send(counts_buffer, num_pairs, MPI_INT, dest, 0, MPI_COMM_WORLD);
-    
-    delete[] str_buffer;
-    delete[] counts_buffer;
+/**
+ * Modo de memória limitada: quando o conjunto passa do orçamento (ou sempre,
+ * com force), cada tabela vira uma run no spiller do seu N e o vocabulário
+ * compartilhado é esvaziado.
+ */
+void maybeSpill(NgramCountSet& ngramCounts, vector<unique_ptr<RunSpiller> >& spillers, bool force = false) {
+    if (spillers.empty()) return;
+    if (!force && !spillers[0]->over_budget(ngramCounts.memory_bytes())) return;
+    PhaseTimer timer(PH_SPILL);
+    for (size_t i = 0; i < spillers.size(); i++) {
+        uint64_t before = spillers[i]->bytes();
+        spillers[i]->spill(ngramCounts.vocab, ngramCounts.tables[i]);
+        profile.count(CT_BYTES_SPILLED, spillers[i]->bytes() - before);
+    }
+    ngramCounts.vocab = Vocabulary();
 }
 
-unordered_map<string, int> receiveOptimizedMap(int source) {
-    MPI_Status status;
-    int num_pairs;
-    size_t str_buffer_size;
+/**
+ * Cada processo abre o arquivo, lê apenas a sua faixa e conta seus n-gramas.
+ * Com spillers (modo de memória limitada), a faixa é lida e contada em
+ * janelas, e as tabelas vão para o disco sempre que passam do orçamento.
+ */
+void countOwnRange(const char* path, int my_rank, int nprocs, int num_threads, NgramCountSet& ngramCounts,
+                   vector<unique_ptr<RunSpiller> >& spillers) {
+    RangeInput input;
+    openRangeInput(path, my_rank, input);
+    MPI_Offset file_size = input.size;
+
+    MPI_Offset begin = file_size * my_rank / nprocs;
+    MPI_Offset end = file_size * (my_rank + 1) / nprocs;
+    MPI_Offset window = end - begin;
+    if (!spillers.empty()) window = max(spillers[0]->budget_bytes() / 16, MIN_WINDOW_CHARS);
+
+    // Cada janela é lida como uma faixa própria: a palavra que cruza o seu
+    // início é da janela anterior, que a lê junto com o lookahead
+    size_t owned_chars;
+    string buffer;
+    MPI_Offset w = begin;
+    mapped_file_advise(&input.mapped, w, window, MADV_WILLNEED);
+    do {
+        MPI_Offset w_end = min(end, w + window);
+        string_view local_text = rangeText(input, w, w_end, buffer, owned_chars);
+        // O kernel já traz a próxima janela enquanto esta é contada
+        if (w_end < end) mapped_file_advise(&input.mapped, w_end, window, MADV_WILLNEED);
 
-    MPI_Recv(&num_pairs, 1, MPI_INT, source, 0, MPI_COMM_WORLD, &status);
-    MPI_Recv(&str_buffer_size, 1, MPI_UNSIGNED_LONG, source, 0, MPI_COMM_WORLD, &status);
+        if (config.debug) {
+            cout << "[Rank " << my_rank << "] Li bytes [" << w << ", " << w_end << ") de " << path << " ("
+                 << local_text.length() << " chars com lookahead)" << endl;
+        }
+
+        countOwnedNgrams(local_text, owned_chars, ngramCounts, num_threads);
+        maybeSpill(ngramCounts, spillers);
+        // As páginas já contadas saem do processo (continuam no page cache)
+        if (!spillers.empty()) mapped_file_advise(&input.mapped, w, w_end - w, MADV_DONTNEED);
+        w = w_end;
+    } while (w < end);
+    closeRangeInput(input);
+}
 
-    if (num_pairs == 0) {
-        return unordered_map<string, int>();
+/**
+ * Balanceamento dinâmico: o Rank 0 expõe numa janela MPI o índice do próximo
+ * bloco livre, e cada processo o incrementa com MPI_Fetch_and_op para pegar
+ * um bloco, lê esse bloco (com o lookahead) e conta seus n-gramas na própria
+ * tabela, até não sobrar nenhum. Quem termina um bloco mais rápido simplesmente
+ * pega mais blocos, para qualquer número de processos.
+ */
+void countDynamicBlocks(const char* path, int my_rank, int num_threads, NgramCountSet& ngramCounts,
+                        vector<unique_ptr<RunSpiller> >& spillers) {
+    RangeInput input;
+    openRangeInput(path, my_rank, input);
+    MPI_Offset file_size = input.size;
+    MPI_Offset block_chars = config.block_chars;
+    long long num_blocks = (file_size + block_chars - 1) / block_chars;
+
+    // Contador do próximo bloco livre, só na memória do Rank 0
+    long long* next_block;
+    MPI_Win win;
+    MPI_Win_allocate(my_rank == 0 ? sizeof(long long) : 0, sizeof(long long), MPI_INFO_NULL,
+                     MPI_COMM_WORLD, &next_block, &win);
+    if (my_rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, win);
+        *next_block = 0;
+        MPI_Win_unlock(0, win);
     }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    const long long one = 1;
+    string buffer;
+    int blocks_done = 0;
+    while (true) {
+        long long block;
+        PhaseTimer fetch_timer(PH_COLLECTIVE);
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, win);
+        MPI_Fetch_and_op(&one, &block, MPI_LONG_LONG, 0, 0, MPI_SUM, win);
+        MPI_Win_unlock(0, win);
+        fetch_timer.stop();
+        if (block >= num_blocks) break;
 
-    char* str_buffer = new char[str_buffer_size];
-    int* counts_buffer = new int[num_pairs];
-    
-    MPI_Recv(str_buffer, str_buffer_size, MPI_CHAR, source, 0, MPI_COMM_WORLD, &status);
-    MPI_Recv(counts_buffer, num_pairs, MPI_INT, source, 0, MPI_COMM_WORLD, &status);
+        MPI_Offset begin = block * block_chars;
+        MPI_Offset end = min(file_size, begin + block_chars);
+        size_t owned_chars;
+        mapped_file_advise(&input.mapped, begin, end - begin, MADV_WILLNEED);
+        string_view text = rangeText(input, begin, end, buffer, owned_chars);
+        countOwnedNgrams(text, owned_chars, ngramCounts, num_threads);
+        maybeSpill(ngramCounts, spillers);
+        mapped_file_advise(&input.mapped, begin, end - begin, MADV_DONTNEED);
+        blocks_done++;
+    }
 
-    unordered_map<string, int> ngrams;
-    size_t str_offset = 0;
-    for (int i = 0; i < num_pairs; i++) {
-        string ngram(str_buffer + str_offset);
-        str_offset += ngram.length() + 1;
-        ngrams[ngram] = counts_buffer[i];
+    if (config.debug) {
+        cout << "[Rank " << my_rank << "] Contei " << blocks_done << " de " << num_blocks << " blocos de " << path << endl;
     }
-    
-    delete[] str_buffer;
-    delete[] counts_buffer;
-    return ngrams;
+
+    MPI_Win_free(&win);
+    closeRangeInput(input);
 }
 
-// --- LÓGICA PRINCIPAL MODIFICADA ---
+// --- Redução por Particionamento (All-to-All) ---
 
-int ngram_parallel() {
-    MPI_Init(NULL, NULL);
+/**
+ * Cada processo envia a cada outro os n-gramas cujo hash cai na fatia dele
+ * (hash % nprocs), serializados como em sendOptimizedMap, e fica só com a
+ * própria fatia, somando o que recebeu de todos.
+ */
+void reduceShuffle(NgramCounts& ngramCounts, int nprocs) {
+    const NgramTable& table = ngramCounts.table;
 
+    // 1. Separar as entradas por processo dono e serializar cada grupo
+    PhaseTimer serialize_timer(PH_SERIALIZE);
+    vector<vector<uint32_t> > entries_for(nprocs);
+    for (size_t e = 0; e < table.size(); e++) {
+        entries_for[table.hash(e) % nprocs].push_back(e);
+    }
+    string send_buffer;
+    vector<size_t> send_bytes(nprocs);
+    for (int p = 0; p < nprocs; p++) {
+        size_t before = send_buffer.length();
+        serializeNgrams(ngramCounts, &entries_for[p], send_buffer);
+        send_bytes[p] = send_buffer.length() - before;
+        vector<uint32_t>().swap(entries_for[p]);
+    }
+    serialize_timer.stop();
+
+    // 2. Trocar os tamanhos e depois as mensagens
+    PhaseTimer exchange_timer(PH_COLLECTIVE);
+    vector<size_t> recv_bytes(nprocs);
+    MPI_Alltoall(&send_bytes[0], 1, MPI_UINT64_T, &recv_bytes[0], 1, MPI_UINT64_T, MPI_COMM_WORLD);
+    vector<size_t> recv_off = offsetsOf(recv_bytes);
+    vector<char> recv_buffer(recv_off[nprocs] + 1);
+    exchangeBytes(send_buffer.data(), send_bytes, &recv_buffer[0], recv_bytes);
+    string().swap(send_buffer);
+    exchange_timer.stop();
+    if (profile.enabled()) {
+        int my_rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+        for (int p = 0; p < nprocs; p++) {
+            if (p == my_rank) continue; // A própria fatia não passa pela rede
+            profile.count(CT_MESSAGES_SENT, send_bytes[p] > 0);
+            profile.count(CT_BYTES_SENT, send_bytes[p]);
+            profile.count(CT_MESSAGES_RECEIVED, recv_bytes[p] > 0);
+            profile.count(CT_BYTES_RECEIVED, recv_bytes[p]);
+        }
+    }
+
+    // 3. A fatia deste processo substitui a contagem local
+    PhaseTimer merge_timer(PH_RECEIVED_MERGE);
+    NgramCounts shard(table.n());
+    for (int p = 0; p < nprocs; p++) {
+        if (!mergeSerializedNgrams(&recv_buffer[recv_off[p]], recv_bytes[p], shard)) {
+            cerr << "Mensagem de n-gramas inválida recebida de " << p << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    ngramCounts = std::move(shard);
+}
+
+/**
+ * Conta no perfil os dados de uma coletiva com `bytes` por processo, como a
+ * aplicação os vê (não pelo algoritmo interno do MPI): sem raiz (Allreduce),
+ * cada processo envia o seu buffer e recebe o resultado; com raiz (Reduce),
+ * os outros enviam e a raiz recebe um buffer de cada.
+ */
+void countCollective(size_t bytes, int root = -1) {
+    if (!profile.enabled()) return;
     int my_rank, nprocs;
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+    if (nprocs == 1) return;
+    if (my_rank != root) {
+        profile.count(CT_MESSAGES_SENT, 1);
+        profile.count(CT_BYTES_SENT, bytes);
+    }
+    if (root < 0) {
+        profile.count(CT_MESSAGES_RECEIVED, 1);
+        profile.count(CT_BYTES_RECEIVED, bytes);
+    } else if (my_rank == root) {
+        profile.count(CT_MESSAGES_RECEIVED, nprocs - 1);
+        profile.count(CT_BYTES_RECEIVED, bytes * (nprocs - 1));
+    }
+}
 
-    double start_time = MPI_Wtime();
+// MPI_Op que junta resumos HeavyHitters inteiros: cada elemento do tipo é um
+// resumo completo, já que a junção não vale entrada a entrada
+void mergeHeavyHittersOp(void* in, void* inout, int* len, MPI_Datatype* type) {
+    int type_bytes;
+    MPI_Type_size(*type, &type_bytes);
+    size_t k = type_bytes / sizeof(HeavyHitter);
+    for (int i = 0; i < *len; i++) {
+        HeavyHitters::merge((const HeavyHitter*)in + i * k, (HeavyHitter*)inout + i * k, k);
+    }
+}
+
+/**
+ * Redução aproximada dos n-gramas frequentes. Cada processo resume a própria
+ * tabela num Count-Min e num Space-Saving; os resumos, de tamanho fixo, são
+ * somados com MPI_Reduce/MPI_Allreduce (o Space-Saving com um MPI_Op próprio).
+ * Os candidatos (contagem estimada >= limiar) são então procurados nas
+ * tabelas locais, e só essas entradas vão para a raiz, para que ela tenha o
+ * texto de cada um. A comunicação é O(tamanho dos resumos + candidatos), e
+ * não O(n-gramas únicos).
+ */
+void reduceSketch(NgramCounts& ngramCounts, int my_rank, int nprocs, long long global_stats[3],
+                  vector<ResultEntry>& results) {
+    const NgramTable& table = ngramCounts.table;
 
-    string local_text; // <-- O dado principal agora é a string de texto
+    // 1. Resumos locais
+    PhaseTimer sketch_timer(PH_SKETCH);
+    CountMinSketch sketch(config.sketch_epsilon, config.sketch_delta);
+    for (size_t e = 0; e < table.size(); e++) sketch.add(table.hash(e), table.count(e));
+    HeavyHitters top(config.sketch_top_k);
+    top.build(table);
+    sketch_timer.stop();
+
+    // 2. Reduções de tamanho fixo
+    PhaseTimer reduce_timer(PH_COLLECTIVE);
+    long long local_total = countTotalNgrams(ngramCounts);
+    MPI_Allreduce(&local_total, &global_stats[0], 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Reduce(my_rank == 0 ? MPI_IN_PLACE : sketch.data(), sketch.data(), sketch.size(), MPI_UINT32_T,
+               MPI_SUM, 0, MPI_COMM_WORLD);
+    countCollective(sketch.size() * sizeof(uint32_t), 0);
+
+    // O resumo vai como um único elemento: com k elementos, o MPI poderia
+    // reduzir pedaços do vetor separadamente (num allreduce em anel, por exemplo)
+    MPI_Datatype hh_type;
+    MPI_Type_contiguous(3 * top.capacity(), MPI_UINT64_T, &hh_type);
+    MPI_Type_commit(&hh_type);
+    MPI_Op hh_merge;
+    MPI_Op_create(mergeHeavyHittersOp, 1, &hh_merge);
+    MPI_Allreduce(MPI_IN_PLACE, top.data(), 1, hh_type, hh_merge, MPI_COMM_WORLD);
+    countCollective(top.capacity() * sizeof(HeavyHitter));
+    MPI_Op_free(&hh_merge);
+    MPI_Type_free(&hh_type);
+    reduce_timer.stop();
+
+    // 3. Cada processo envia à raiz as suas entradas dos candidatos
+    sketch_timer.restart();
+    unordered_map<uint64_t, uint64_t> candidates;
+    for (size_t i = 0; i < top.capacity(); i++) {
+        if (top[i].count >= (uint64_t)config.min_threshold) candidates[top[i].hash] = top[i].count;
+    }
+    vector<uint32_t> mine;
+    for (size_t e = 0; e < table.size(); e++) {
+        if (candidates.count(table.hash(e))) mine.push_back(e);
+    }
+    sketch_timer.stop();
+    PhaseTimer serialize_timer(PH_SERIALIZE);
+    string send_buffer;
+    serializeNgrams(ngramCounts, &mine, send_buffer);
+    size_t send_bytes = send_buffer.length();
+    serialize_timer.stop();
+    if (my_rank != 0) {
+        profile.count(CT_MESSAGES_SENT, 1);
+        profile.count(CT_BYTES_SENT, send_bytes);
+    }
+    reduce_timer.restart();
+    vector<size_t> recv_bytes, recv_off;
+    vector<char> recv_buffer;
+    gatherBytes(send_buffer, 0, recv_buffer, recv_bytes, recv_off);
+    reduce_timer.stop();
+
+    global_stats[1] = -1; // Desconhecido neste modo
+    global_stats[2] = 0;
+    if (my_rank != 0) return;
+
+    // 4. Na raiz: a soma das entradas recebidas é a contagem exata de cada candidato
+    PhaseTimer merge_timer(PH_RECEIVED_MERGE);
+    NgramCounts found(table.n());
+    for (int p = 0; p < nprocs; p++) {
+        if (p != 0) {
+            profile.count(CT_MESSAGES_RECEIVED, 1);
+            profile.count(CT_BYTES_RECEIVED, recv_bytes[p]);
+        }
+        if (!mergeSerializedNgrams(&recv_buffer[recv_off[p]], recv_bytes[p], found)) {
+            cerr << "Mensagem de n-gramas inválida recebida de " << p << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    merge_timer.stop();
+    if (!config.sketch_verify) {
+        // Sem verificação, a contagem relatada é a estimativa (um limite superior)
+        NgramCounts estimated(table.n());
+        string ngram;
+        for (size_t e = 0; e < found.table.size(); e++) {
+            uint64_t hash = found.table.hash(e);
+            found.ngram_text(e, ngram);
+            estimated.add_text(ngram.data(), ngram.length(), (uint32_t)min(candidates[hash], (uint64_t)sketch.estimate(hash)));
+        }
+        found = std::move(estimated);
+    }
+
+    global_stats[2] = countSignificantNgrams(found, config.min_threshold);
+    if (wantResults()) collectSignificant(found, results);
+}
+
+// MPI_Op: soma com saturação de dois ThresholdSketch
+void saturatingAddOp(void* in, void* inout, int* len, MPI_Datatype*) {
+    ThresholdSketch::saturating_add((const uint8_t*)in, (uint8_t*)inout, *len, config.min_threshold);
+}
+
+/**
+ * Filtro exato em duas fases. Fase 1: cada processo soma suas contagens num
+ * ThresholdSketch, e os sketches são somados entre todos com MPI_Allreduce.
+ * Como a estimativa do sketch nunca é menor que a contagem global, quem tem
+ * estimativa menor que o limiar certamente não é significativo e sai da tabela.
+ * Fase 2 (a redução normal, depois desta função) só leva os candidatos, com
+ * as contagens exatas. Devolve o total global de n-gramas.
+ */
+long long prefilterNgrams(NgramCounts& ngramCounts, int my_rank) {
+    const NgramTable& table = ngramCounts.table;
+    long long local[2] = { countTotalNgrams(ngramCounts), (long long)table.size() }, global[2];
+    PhaseTimer reduce_timer(PH_COLLECTIVE);
+    MPI_Allreduce(local, global, 2, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    reduce_timer.stop();
+    if (config.min_threshold <= 1) return global[0]; // Toda entrada presente atinge o limiar
+
+    PhaseTimer sketch_timer(PH_SKETCH);
+    int bits = ThresholdSketch::bits_for(config.min_threshold);
+    size_t width = min((size_t)(PREFILTER_COUNTERS * global[1]), PREFILTER_MAX_BYTES * 8 / bits / PREFILTER_ROWS);
+    ThresholdSketch sketch(width, PREFILTER_ROWS, config.min_threshold);
+    for (size_t e = 0; e < table.size(); e++) sketch.add(table.hash(e), table.count(e));
+    sketch_timer.stop();
+    reduce_timer.restart();
+    MPI_Op saturating_add;
+    MPI_Op_create(saturatingAddOp, 1, &saturating_add);
+    MPI_Allreduce(MPI_IN_PLACE, sketch.data(), sketch.size(), MPI_UINT8_T, saturating_add, MPI_COMM_WORLD);
+    countCollective(sketch.size());
+    MPI_Op_free(&saturating_add);
+    reduce_timer.stop();
+
+    sketch_timer.restart();
+    NgramCounts candidates(table.n());
+    candidates.vocab = ngramCounts.vocab;
+    for (size_t e = 0; e < table.size(); e++) {
+        if (sketch.may_reach(table.hash(e))) candidates.table.add_entry(table, e);
+    }
+
+    if (config.debug) {
+        cout << "[Rank " << my_rank << "] Filtro (N = " << table.n() << "): " << candidates.table.size() << " de "
+             << table.size() << " n-gramas são candidatos" << endl;
+    }
+
+    ngramCounts = std::move(candidates);
+    return global[0];
+}
+
+/**
+ * Redução do modo de memória limitada, para as runs de um N (o que estava na
+ * memória já virou a última run, ver maybeSpill). O espaço de hash é cortado em fases, e em cada fase
+ * todos os processos leem das suas runs (pela junção de k vias, que já vem em
+ * ordem de hash) só os n-gramas da faixa da fase e os redistribuem com
+ * reduceShuffle. O número de fases é escolhido para que a fatia de uma fase
+ * caiba no orçamento, então a memória não depende do tamanho da entrada.
+ */
+void reduceStreaming(RunSpiller& spiller, int N, int my_rank, int nprocs, long long global_stats[3],
+                     vector<ResultEntry>& results) {
+    // Junção em várias passadas antes, para que a final abra no máximo max_fan_in() runs
+    PhaseTimer spill_timer(PH_SPILL);
+    size_t run_count = spiller.runs().size();
+    size_t intermediate = spiller.merge_runs(spiller.max_fan_in());
+    spill_timer.stop();
+
+    unsigned long long local_bytes = spiller.bytes(), max_bytes, total_bytes;
+    unsigned long long local_total = spiller.total_count();
+    MPI_Allreduce(&local_bytes, &max_bytes, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&local_bytes, &total_bytes, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&local_total, &global_stats[0], 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    // Numa fase, um processo guarda o que leu das suas runs e o que recebe dos
+    // outros, como tabela e como mensagens: algumas vezes o tamanho em disco
+    unsigned long long phase_bytes = max(max_bytes, total_bytes / nprocs) * 4;
+    long long num_phases = max(1ULL, (phase_bytes + spiller.budget_bytes() - 1) / spiller.budget_bytes());
+    uint64_t step = (num_phases == 1) ? 0 : UINT64_MAX / num_phases + 1;
+
+    if (config.debug) {
+        cout << "[Rank " << my_rank << "] " << run_count << " runs de N = " << N;
+        if (intermediate > 0) cout << ", juntadas em " << spiller.runs().size() << " (" << intermediate << " intermediárias)";
+        cout << " (" << local_bytes << " bytes); redução em " << num_phases << " fases" << endl;
+    }
+
+    RunMerger merger(spiller.runs());
+    long long local_stats[2] = { 0, 0 };
+    uint64_t hash;
+    string text;
+    uint32_t count;
+    for (long long phase = 0; phase < num_phases; phase++) {
+        NgramCounts slice(N);
+        PhaseTimer read_timer(PH_READ);
+        while (!merger.at_end() && (step == 0 || (long long)(merger.peek_hash() / step) <= phase)) {
+            merger.next(hash, text, count);
+            slice.add_text(text.data(), text.length(), count);
+        }
+        read_timer.stop();
+        reduceShuffle(slice, nprocs);
+        local_stats[0] += slice.table.size();
+        local_stats[1] += countSignificantNgrams(slice, config.min_threshold);
+
+        if (wantResults()) collectSignificant(slice, results);
+    }
+    MPI_Allreduce(local_stats, &global_stats[1], 2, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+}
+
+// --- Distribuição pela Árvore ---
+
+/**
+ * O Rank 0 lê o arquivo e o texto desce pela árvore (2r+1, 2r+2), sendo
+ * dividido ao meio até ficar menor que --char-threshold ou chegar a uma folha.
+ * Cada nó conta em ngramCounts a parte do texto que ficou com ele.
+ */
+void distributeText(const char* path, int my_rank, int nprocs, int num_threads, NgramCountSet& ngramCounts) {
     int parent_rank = (my_rank - 1) / 2;
+    int left_child = (2 * my_rank) + 1;
+    int right_child = (2 * my_rank) + 2;
+    bool has_left_child = (left_child < nprocs);
+    bool has_right_child = (right_child < nprocs);
+    int lookahead_tokens = config.max_n() - 1;
+
+    // O único buffer de texto deste nó: recebido do pai ou, na raiz, o
+    // arquivo mapeado. Os pedaços dos filhos e a parte local são
+    // views/offsets dentro dele.
+    string buffer;
+    MappedFile input = {};
+    string_view local_text;
+    // Os primeiros owned_chars bytes de local_text são deste nó; o resto é o
+    // lookahead com os (N-1) tokens seguintes, que só completam n-gramas.
+    size_t owned_chars;
 
     if (my_rank != 0) {
         // --- Processo Filho ---
-        // 1. Recebe seu bloco principal de TEXTO
-        string my_text_chunk = receiveOptimizedString(parent_rank);
-        
-        // 2. Recebe o bloco de TEXTO de SOBREPOSIÇÃO
-        string overlap_text = receiveOptimizedString(parent_rank);
-        
-        // 3. Concatena para formar o texto local
-        //    (Overlap vem primeiro)
-        local_text = overlap_text + my_text_chunk;
+        // Recebe seu bloco de TEXTO, já seguido dos (N-1) tokens de lookahead
+        local_text = receiveOptimizedString(parent_rank, buffer, owned_chars);
         
-        #if DEBUG
-        cout << "[Rank " << my_rank << "] Recebi " << local_text.length() << " chars (incluindo " << overlap_text.length() << " de overlap) do pai " << parent_rank << endl;
-        #endif
+        if (config.debug) {
+            cout << "[Rank " << my_rank << "] Recebi " << local_text.length() << " chars (incluindo " << local_text.length() - owned_chars << " de lookahead) do pai " << parent_rank << endl;
+        }
 
     } else {
         // --- Processo Raiz (Rank 0) ---
-        const char *input_path = "big_bible.txt"; 
-        string text = read_file_to_string(input_path);
-        if (text.empty()) {
+        if (!openInput(path, input)) {
             MPI_Abort(MPI_COMM_WORLD, 1);
-            return 1;
         }
-        local_text = text; // O texto do Rank 0 é o arquivo inteiro
+        local_text = string_view(input.data, input.size); // O texto do Rank 0 é o arquivo inteiro
+        owned_chars = local_text.length();
 
-        #if DEBUG
-        cout << "[Rank " << my_rank << "] Total de chars lidos: " << local_text.length() << endl;
-        #endif
+        if (config.debug) {
+            cout << "[Rank " << my_rank << "] Total de chars lidos de " << path << ": " << local_text.length() << endl;
+        }
     }
 
-    unordered_map<string, int> ngramCounts;
-    int N = N_GRAM_SIZE;
-    size_t num_local_chars = local_text.length();
-    int left_child = (2 * my_rank) + 1;
-    int right_child = (2 * my_rank) + 2;
-    bool has_left_child = (left_child < nprocs);
+    size_t num_local_chars = owned_chars;
+    TextSend left_send, right_send;
 
     // Decidir: dividir ou conquistar?
     // Conquistar se o texto for pequeno OU se eu for uma folha na árvore MPI
-    if (num_local_chars <= CHAR_THRESHOLD || !has_left_child) {
+    if (num_local_chars <= config.char_threshold || !has_left_child) {
         // --- Conquistar ---
-        #if DEBUG
-        cout << "[Rank " << my_rank << "] Conquistando com " << num_local_chars << " chars" << endl;
-        #endif
+        if (config.debug) {
+            cout << "[Rank " << my_rank << "] Conquistando com " << num_local_chars << " chars" << endl;
+        }
+
+        // Os filhos que existirem recebem blocos vazios, para não ficarem
+        // esperando por texto que nunca chega
+        if (has_left_child) {
+            sendOptimizedString("", 0, 0, left_child, left_send);
+        }
+        if (has_right_child) {
+            sendOptimizedString("", 0, 0, right_child, right_send);
+        }
         
         // ** A TOKENIZAÇÃO ACONTECE AQUI, NO NÓ FOLHA **
-        // Isso distribui o uso de memória do vector<string>
-        vector<string> local_tokens = tokenize_optimized(local_text);
-        
-        ngramCounts = generateAndCountNgrams(local_tokens, N, 0, local_tokens.size());
+        countOwnedNgrams(local_text, owned_chars, ngramCounts, num_threads);
+
+        if (has_left_child) waitText(left_send);
+        if (has_right_child) waitText(right_send);
 
     } else {
         // --- Dividir ---
-        bool has_right_child = (right_child < nprocs);
-        
-        #if DEBUG
-        cout << "[Rank " << my_rank << "] Dividindo " << num_local_chars << " chars. Esq: " << left_child << " | Dir: " << right_child << endl;
-        #endif
+        if (config.debug) {
+            cout << "[Rank " << my_rank << "] Dividindo " << num_local_chars << " chars. Esq: " << left_child << " | Dir: " << right_child << endl;
+        }
 
         // 1. Encontrar ponto de divisão (no meio, em uma quebra de palavra)
         size_t split_index = num_local_chars / 2;
-        size_t real_split = local_text.find_first_of(" \t\n", split_index);
-        if (real_split == string::npos) {
-            real_split = split_index; // Fallback se não achar espaço
-        }
+        size_t real_split = split_index;
+        while (real_split < owned_chars && !is_separator(local_text[real_split])) real_split++;
 
-        // 2. Calcular overlap (baseado em CHARS)
-        size_t overlap_start = (real_split > OVERLAP_CHARS) ? (real_split - OVERLAP_CHARS) : 0;
+        // 2. O filho esquerdo precisa dos (N-1) tokens que vêm depois do corte;
+        //    o direito herda o lookahead deste nó
+        size_t left_lookahead_end = find_lookahead_end(local_text, real_split, lookahead_tokens, true, config.normalization);
         
-        // 3. Criar os pedaços de STRING
-        string left_chunk_str = local_text.substr(0, real_split);
-        string right_chunk_str = local_text.substr(real_split);
-        // O overlap é [overlap_start ... real_split]
-        string overlap_str = local_text.substr(overlap_start, real_split - overlap_start);
-
-        // 4. Enviar para filho esquerdo
-        sendOptimizedString(left_chunk_str, left_child);
-        sendOptimizedString("", left_child); // Envia overlap vazio
+        // 3. Enviar para filho esquerdo: [0, real_split) + lookahead, sem copiar
+        sendOptimizedString(local_text.data(), left_lookahead_end, real_split, left_child, left_send);
 
-        // 5. Enviar para filho direito (se existir) ou processar localmente
+        // 4. Enviar para filho direito (se existir) ou processar localmente,
+        //    enquanto os envios progridem
         if (has_right_child) {
-            sendOptimizedString(right_chunk_str, right_child);
-            sendOptimizedString(overlap_str, right_child); // Envia overlap real
+            sendOptimizedString(local_text.data() + real_split, local_text.length() - real_split,
+                                owned_chars - real_split, right_child, right_send);
         } else {
             // Filho direito não existe, processo o bloco direito eu mesmo
-            #if DEBUG
-            cout << "[Rank " << my_rank << "] Filho direito não existe, processando localmente" << endl;
-            #endif
-            
-            // Concatena o texto
-            string final_right_text = overlap_str + right_chunk_str;
+            if (config.debug) {
+                cout << "[Rank " << my_rank << "] Filho direito não existe, processando localmente" << endl;
+            }
             
             // ** A TOKENIZAÇÃO ACONTECE AQUI **
-            vector<string> right_tokens = tokenize_optimized(final_right_text);
-            
-            // O resultado da direita vai direto para o `ngramCounts` deste nó
-            ngramCounts = generateAndCountNgrams(right_tokens, N, 0, right_tokens.size());
+            countOwnedNgrams(local_text.substr(real_split), owned_chars - real_split, ngramCounts, num_threads);
         }
 
-        // 6. Receber resultados do filho esquerdo
-        unordered_map<string, int> left_ngrams = receiveOptimizedMap(left_child);
-        mergeNgramMaps(ngramCounts, left_ngrams); // Mescla com os resultados da direita (se houver)
+        // 5. O texto só pode ser liberado depois que os envios terminarem
+        waitText(left_send);
+        if (has_right_child) waitText(right_send);
+    }
+    mapped_file_close(&input);
+}
 
-        // 7. Receber resultados do filho direito (se foi enviado)
-        if (has_right_child) {
-            unordered_map<string, int> right_ngrams = receiveOptimizedMap(right_child);
-            mergeNgramMaps(ngramCounts, right_ngrams);
+/**
+ * Redução em árvore: soma os mapas dos filhos e envia o resultado ao pai.
+ * Ao final, só a raiz tem a contagem completa. my_rank e nprocs são os de
+ * `comm`.
+ */
+void reduceTree(NgramCounts& ngramCounts, int my_rank, int nprocs, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    int parent_rank = (my_rank - 1) / 2;
+    int left_child = (2 * my_rank) + 1;
+    int right_child = (2 * my_rank) + 2;
+
+    int num_children = (left_child < nprocs) + (right_child < nprocs);
+    receiveOptimizedMaps(num_children, tag, ngramCounts, comm);
+
+    if (my_rank != 0) {
+        if (config.debug) {
+            cout << "[Rank " << my_rank << "] Enviando " << ngramCounts.table.size() << " n-gramas únicos para o pai " << parent_rank << endl;
         }
+        sendOptimizedMap(ngramCounts, parent_rank, tag, comm);
+        ngramCounts = NgramCounts(ngramCounts.table.n()); // Agora só o pai tem estas contagens
+    }
+}
+
+// Comunicadores da redução em dois níveis: os processos do nó e os líderes dos nós
+struct NodeComms {
+    MPI_Comm node;
+    MPI_Comm leaders;   // MPI_COMM_NULL fora dos líderes
+    int node_rank, node_size;
+};
 
-        #if DEBUG
-        cout << "[Rank " << my_rank << "] Mesclei resultados dos filhos" << endl;
-        #endif
+/**
+ * Agrupa os processos por nó (MPI_COMM_TYPE_SHARED), uma vez por execução.
+ * O líder de cada nó é o seu menor rank, então o Rank 0 é o líder 0 e a
+ * contagem final fica com ele, como na árvore simples.
+ */
+const NodeComms& nodeComms() {
+    static NodeComms comms;
+    static bool created = false;
+    if (!created) {
+        int my_rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+        MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, &comms.node);
+        MPI_Comm_rank(comms.node, &comms.node_rank);
+        MPI_Comm_size(comms.node, &comms.node_size);
+        MPI_Comm_split(MPI_COMM_WORLD, comms.node_rank == 0 ? 0 : MPI_UNDEFINED, my_rank, &comms.leaders);
+        created = true;
     }
+    return comms;
+}
 
-    // --- Envio para o pai ou imprimo se sou raiz ---
-    if (my_rank != 0) {
-        #if DEBUG
-        cout << "[Rank " << my_rank << "] Enviando " << ngramCounts.size() << " n-gramas únicos para o pai " << parent_rank << endl;
-        #endif
-        sendOptimizedMap(ngramCounts, parent_rank);
+/**
+ * Redução em dois níveis (--reduce node). Dentro do nó, cada processo soma a
+ * sua tabela numa NodeTable (node_table.h) alocada com
+ * MPI_Win_allocate_shared, todos ao mesmo tempo e sem serializar nem enviar
+ * nada; o líder refaz dela a sua NgramCounts. Depois, só os líderes fazem a
+ * redução em árvore, entre os nós. Ao final, só o Rank 0 tem a contagem.
+ */
+void reduceNode(NgramCounts& ngramCounts, int tag) {
+    const NodeComms& comms = nodeComms();
+    int N = ngramCounts.table.n();
+
+    // 1. O bloco do nó, dimensionado pela soma dos tamanhos locais
+    PhaseTimer collective_timer(PH_COLLECTIVE);
+    const Vocabulary& vocab = ngramCounts.vocab;
+    const NgramTable& table = ngramCounts.table;
+    uint64_t local[3] = { vocab.size(), 0, table.size() };
+    for (uint32_t id = 0; id < vocab.size(); id++) local[1] += vocab.length(id);
+    uint64_t summed[3];
+    MPI_Allreduce(local, summed, 3, MPI_UINT64_T, MPI_SUM, comms.node);
+    NodeTableSizes sizes = { summed[0], summed[1], summed[2] };
+
+    char* base;
+    MPI_Win win;
+    MPI_Aint bytes = (comms.node_rank == 0) ? NodeTable::bytes(sizes, N) : 0;
+    MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, comms.node, &base, &win);
+    int disp_unit;
+    MPI_Win_shared_query(win, 0, &bytes, &disp_unit, &base);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    if (comms.node_rank == 0) memset(base, 0, bytes);
+    MPI_Win_sync(win);
+    MPI_Barrier(comms.node);
+    MPI_Win_sync(win);
+    collective_timer.stop();
+
+    // 2. Cada processo soma a sua tabela na do nó, com os IDs traduzidos
+    PhaseTimer merge_timer(PH_NODE_MERGE);
+    NodeTable shared(base, sizes, N);
+    vector<uint32_t> remap(vocab.size());
+    for (uint32_t id = 0; id < remap.size(); id++) {
+        remap[id] = shared.intern(vocab.data(id), vocab.length(id), vocab.word_hash(id));
+    }
+    vector<uint32_t> ids(N);
+    for (size_t e = 0; e < table.size(); e++) {
+        const uint32_t* key = table.key(e);
+        for (int j = 0; j < N; j++) ids[j] = remap[key[j]];
+        shared.add(&ids[0], table.hash(e), table.count(e));
+    }
+    ngramCounts = NgramCounts(N); // Agora a tabela do nó tem estas contagens
+    merge_timer.stop();
+
+    collective_timer.restart();
+    MPI_Win_sync(win);
+    MPI_Barrier(comms.node);
+    MPI_Win_sync(win);
+    collective_timer.stop();
+
+    // 3. O líder refaz a contagem; as palavras entram na ordem dos IDs do nó,
+    // então os IDs do vocabulário novo são os mesmos
+    if (comms.node_rank == 0) {
+        merge_timer.restart();
+        for (uint32_t id = 0; id < shared.words(); id++) ngramCounts.vocab.intern(shared.word(id), shared.word_length(id));
+        NgramTable& merged = ngramCounts.table;
+        merged.reserve(shared.entries());
+        with_fixed_n(N, [&](auto fixed) {
+            for (size_t pos = 0; pos < shared.slots(); pos++) {
+                if (shared.used(pos)) merged.add_mixed<decltype(fixed)::value>(shared.key(pos), shared.hash(pos), shared.count(pos));
+            }
+        });
+        merge_timer.stop();
+        if (config.debug) {
+            int my_rank;
+            MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+            cout << "[Rank " << my_rank << "] Nó com " << comms.node_size << " processos e " << merged.size()
+                 << " n-gramas únicos" << endl;
+        }
+    }
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+
+    // 4. Só os líderes seguem, na árvore entre os nós
+    if (comms.leaders != MPI_COMM_NULL) {
+        int leader_rank, num_leaders;
+        MPI_Comm_rank(comms.leaders, &leader_rank);
+        MPI_Comm_size(comms.leaders, &num_leaders);
+        reduceTree(ngramCounts, leader_rank, num_leaders, tag, comms.leaders);
+    }
+}
+
+/**
+ * Reduz a contagem de um N com o modo escolhido em --reduce (e --prefilter).
+ * Em global_stats ficam, na raiz, o total, os únicos (-1 se desconhecido) e
+ * os significativos; em `results`, se pedidos, os n-gramas significativos
+ * que ficaram com este processo (nenhum n-grama fica em dois processos).
+ */
+void reduceCounts(NgramCounts& ngramCounts, int my_rank, int nprocs, int tag, long long global_stats[3],
+                  vector<ResultEntry>& results) {
+    if (config.reduction == REDUCE_SKETCH) {
+        reduceSketch(ngramCounts, my_rank, nprocs, global_stats, results);
+        return;
+    }
+    long long total_ngrams = 0;
+    if (config.prefilter) total_ngrams = prefilterNgrams(ngramCounts, my_rank);
+
+    if (config.reduction == REDUCE_SHUFFLE) {
+        reduceShuffle(ngramCounts, nprocs);
+
+        // Filtragem em paralelo: cada processo só olha a própria fatia
+        long long local_stats[3] = {
+            countTotalNgrams(ngramCounts),
+            (long long)ngramCounts.table.size(),
+            countSignificantNgrams(ngramCounts, config.min_threshold)
+        };
+        MPI_Allreduce(local_stats, global_stats, 3, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+        if (config.prefilter) {
+            global_stats[0] = total_ngrams;
+            global_stats[1] = -1; // Só os candidatos chegaram até aqui
+        }
+
+        if (config.debug) {
+            cout << "[Rank " << my_rank << "] Fatia com " << local_stats[1] << " n-gramas únicos, "
+                 << local_stats[2] << " significativos" << endl;
+        }
+
+        if (wantResults()) collectSignificant(ngramCounts, results);
+        return;
+    }
+
+    if (config.reduction == REDUCE_NODE) {
+        reduceNode(ngramCounts, tag);
     } else {
-        // Sou a raiz, imprimo resultados
+        reduceTree(ngramCounts, my_rank, nprocs, tag);
+    }
+
+    if (my_rank == 0) {
+        global_stats[0] = countTotalNgrams(ngramCounts);
+        global_stats[1] = ngramCounts.table.size();
+        global_stats[2] = countSignificantNgrams(ngramCounts, config.min_threshold);
+        if (config.prefilter) {
+            global_stats[0] = total_ngrams;
+            global_stats[1] = -1; // Só os candidatos chegaram até aqui
+        }
+
+        if (wantResults()) collectSignificant(ngramCounts, results);
+    }
+}
+
+// --- Estágio de resultados ---
+
+// Tag dos pedaços de resultado que vão para a raiz imprimir (ver emitResults)
+const int TAG_RESULTS = 0;
+
+// Tamanho dos pedaços formatados: de cada mensagem para a raiz e de cada fwrite
+const size_t RESULT_CHUNK_BYTES = 4 << 20;
+
+// Amostras por processo na escolha dos separadores da ordenação distribuída
+const size_t SORT_SAMPLES = 256;
+
+/**
+ * Formata entries a partir de `pos` até `out` passar de RESULT_CHUNK_BYTES
+ * ou as entradas acabarem; devolve onde parou.
+ */
+size_t formatChunk(const vector<ResultEntry>& entries, size_t pos, long long total_ngrams, int format, string& out) {
+    out.clear();
+    while (pos < entries.size() && out.size() < RESULT_CHUNK_BYTES) {
+        format_results(entries, pos, pos + 1, format, total_ngrams, out);
+        pos++;
+    }
+    return pos;
+}
+
+/**
+ * Top-K distribuído: cada processo separa os seus K maiores (nth_element,
+ * sem ordenar o resto) e só esses vão para a raiz, que escolhe os K finais.
+ * Nenhum n-grama está em dois processos, então os K maiores de todos estão
+ * entre os K maiores de algum processo. Os outros processos ficam vazios.
+ */
+void selectTopK(vector<ResultEntry>& entries, int my_rank, int nprocs) {
+    ResultLess by_count = { ORDER_COUNT };
+    size_t k = config.top_k;
+    if (entries.size() > k) {
+        PhaseTimer timer(PH_OUTPUT);
+        nth_element(entries.begin(), entries.begin() + k, entries.end(), by_count);
+        entries.resize(k);
+    }
+
+    PhaseTimer serialize_timer(PH_SERIALIZE);
+    string packed;
+    for (size_t i = 0; i < entries.size(); i++) append_record(packed, entries[i]);
+    serialize_timer.stop();
+
+    PhaseTimer collective_timer(PH_COLLECTIVE);
+    vector<size_t> lens, offs;
+    vector<char> buffer;
+    gatherBytes(packed, 0, buffer, lens, offs);
+    collective_timer.stop();
+
+    entries.clear();
+    if (my_rank != 0) return;
+    PhaseTimer timer(PH_OUTPUT);
+    read_records(&buffer[0], buffer.size() - 1, entries);
+    ResultLess final_order = { config.order == ORDER_NGRAM ? ORDER_NGRAM : ORDER_COUNT };
+    if (entries.size() > k) {
+        nth_element(entries.begin(), entries.begin() + k, entries.end(), by_count);
+        entries.resize(k);
+    }
+    sort(entries.begin(), entries.end(), final_order);
+}
+
+/**
+ * Ordenação distribuída (sample sort): cada processo ordena o que tem e
+ * contribui SORT_SAMPLES amostras igualmente espaçadas, cada uma pesando
+ * a fração da sua lista que representa; os P-1 separadores dividem o peso
+ * total em partes iguais, então um processo com muito mais resultados (a raiz,
+ * na redução em árvore) não fica com a maior fatia. Depois de um Alltoallv,
+ * o processo p tem, ordenada, a p-ésima faixa da ordem global.
+ */
+void sortResults(vector<ResultEntry>& entries, int order, int nprocs) {
+    ResultLess less = { order };
+    PhaseTimer sort_timer(PH_OUTPUT);
+    sort(entries.begin(), entries.end(), less);
+    sort_timer.stop();
+    if (nprocs == 1) return;
+
+    // Amostras: o meio de cada um dos s trechos iguais da lista ordenada
+    size_t n = entries.size();
+    size_t s = min(n, SORT_SAMPLES);
+    string samples;
+    for (size_t j = 0; j < s; j++) append_record(samples, entries[(2 * j + 1) * n / (2 * s)]);
+
+    PhaseTimer collective_timer(PH_COLLECTIVE);
+    long long mine[2] = { (long long)n, (long long)samples.size() };
+    vector<long long> sizes(2 * nprocs);
+    MPI_Allgather(mine, 2, MPI_LONG_LONG, &sizes[0], 2, MPI_LONG_LONG, MPI_COMM_WORLD);
+    vector<int> lens(nprocs), offs(nprocs, 0);
+    for (int p = 0; p < nprocs; p++) lens[p] = sizes[2 * p + 1];
+    for (int p = 1; p < nprocs; p++) offs[p] = offs[p - 1] + lens[p - 1];
+    vector<char> all_samples(offs[nprocs - 1] + lens[nprocs - 1] + 1);
+    MPI_Allgatherv(samples.data(), samples.size(), MPI_CHAR, &all_samples[0], &lens[0], &offs[0], MPI_CHAR,
+                   MPI_COMM_WORLD);
+    collective_timer.stop();
+
+    // Separadores pelo peso acumulado das amostras
+    sort_timer.restart();
+    vector<pair<ResultEntry, double> > weighted;
+    double total_weight = 0;
+    for (int p = 0; p < nprocs; p++) {
+        vector<ResultEntry> from;
+        read_records(&all_samples[offs[p]], lens[p], from);
+        for (size_t j = 0; j < from.size(); j++) {
+            weighted.push_back(make_pair(from[j], (double)sizes[2 * p] / from.size()));
+        }
+        total_weight += sizes[2 * p];
+    }
+    sort(weighted.begin(), weighted.end(),
+         [&](const pair<ResultEntry, double>& a, const pair<ResultEntry, double>& b) { return less(a.first, b.first); });
+    vector<size_t> bounds(nprocs + 1, n);
+    bounds[0] = 0;
+    double acc = 0;
+    size_t w = 0;
+    for (int q = 1; q < nprocs && !weighted.empty(); q++) {
+        while (w < weighted.size() - 1 && acc + weighted[w].second < total_weight * q / nprocs) acc += weighted[w++].second;
+        bounds[q] = lower_bound(entries.begin(), entries.end(), weighted[w].first, less) - entries.begin();
+    }
+    sort_timer.stop();
+
+    PhaseTimer serialize_timer(PH_SERIALIZE);
+    string packed;
+    vector<size_t> send_counts(nprocs), recv_counts(nprocs);
+    for (int p = 0; p < nprocs; p++) {
+        size_t before = packed.size();
+        for (size_t i = bounds[p]; i < bounds[p + 1]; i++) append_record(packed, entries[i]);
+        send_counts[p] = packed.size() - before;
+    }
+    entries.clear();
+    serialize_timer.stop();
+
+    collective_timer.restart();
+    MPI_Alltoall(&send_counts[0], 1, MPI_UINT64_T, &recv_counts[0], 1, MPI_UINT64_T, MPI_COMM_WORLD);
+    vector<char> received(offsetsOf(recv_counts)[nprocs] + 1);
+    exchangeBytes(packed.data(), send_counts, &received[0], recv_counts);
+    collective_timer.stop();
+    string().swap(packed);
+
+    PhaseTimer merge_timer(PH_RECEIVED_MERGE);
+    read_records(&received[0], received.size() - 1, entries);
+    merge_timer.stop();
+    sort_timer.restart();
+    sort(entries.begin(), entries.end(), less);
+}
+
+// Grava buf[0, len) na posição `offset` do arquivo, em blocos que cabem num int
+void writeFileAt(MPI_File fh, MPI_Offset offset, const char* buf, size_t len) {
+    for (size_t done = 0; done < len; ) {
+        int block = min(len - done, (size_t)1 << 30);
+        MPI_Status status;
+        MPI_File_write_at(fh, offset + done, buf + done, block, MPI_CHAR, &status);
+        done += block;
+    }
+}
+
+/**
+ * Grava o arquivo de consulta (--format lookup, ver lookup.h). As entradas
+ * já estão em ordem de texto e a faixa de cada processo vem depois das dos
+ * anteriores (sortResults ou selectTopK), então cada processo grava as suas
+ * contagens, offsets e textos direto no lugar final, dado pelo Exscan do
+ * número de entradas e dos bytes de texto. A raiz grava o cabeçalho e o
+ * último offset.
+ */
+void writeLookup(const vector<ResultEntry>& entries, const string& path, int N, long long total_ngrams, int my_rank) {
+    long long mine[2] = { (long long)entries.size(), 0 }, before[2] = { 0, 0 }, all[2];
+    for (size_t i = 0; i < entries.size(); i++) mine[1] += entries[i].text.length();
+    MPI_Exscan(mine, before, 2, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(mine, all, 2, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (my_rank == 0) before[0] = before[1] = 0; // O Exscan deixa o valor da raiz indefinido
+    LookupHeader header = lookup_header(N, config.normalization, all[0], total_ngrams, all[1]);
+
+    vector<uint32_t> counts(entries.size());
+    vector<uint64_t> offsets(entries.size());
+    string arena;
+    arena.reserve(mine[1]);
+    for (size_t i = 0; i < entries.size(); i++) {
+        counts[i] = entries[i].count;
+        offsets[i] = before[1] + arena.size();
+        arena += entries[i].text;
+    }
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (my_rank == 0) cerr << "Erro ao abrir arquivo: " << path << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_File_set_size(fh, header.arena_offset + header.arena_size);
+    if (my_rank == 0) {
+        writeFileAt(fh, 0, (const char*)&header, sizeof(header));
+        writeFileAt(fh, header.offsets_offset + header.count * sizeof(uint64_t), (const char*)&header.arena_size,
+                    sizeof(uint64_t));
+    }
+    writeFileAt(fh, header.counts_offset + before[0] * sizeof(uint32_t), (const char*)counts.data(),
+                counts.size() * sizeof(uint32_t));
+    writeFileAt(fh, header.offsets_offset + before[0] * sizeof(uint64_t), (const char*)offsets.data(),
+                offsets.size() * sizeof(uint64_t));
+    writeFileAt(fh, header.arena_offset + before[1], arena.data(), arena.size());
+    MPI_File_close(&fh);
+}
+
+/**
+ * Grava os resultados deste processo: com --output-mode parts, no próprio
+ * arquivo (CAMINHO.part-RRRRR); com shared, todos num só arquivo, cada
+ * processo na posição dada pelo Exscan dos tamanhos, com MPI-IO. Com mais
+ * de um N, CAMINHO ganha o sufixo .nN. No formato binário, o cabeçalho vai
+ * no começo de cada parte, ou só uma vez no arquivo compartilhado. O
+ * arquivo de consulta é sempre compartilhado (writeLookup).
+ */
+void writeResults(const vector<ResultEntry>& entries, int N, long long total_ngrams, int my_rank) {
+    PhaseTimer timer(PH_OUTPUT);
+    string base = config.output_path;
+    if (config.ns.size() > 1) base += ".n" + to_string(N);
+    bool binary = config.output_format == FORMAT_BINARY;
+    if (config.output_format == FORMAT_LOOKUP) {
+        writeLookup(entries, base, N, total_ngrams, my_rank);
+        return;
+    }
+
+    if (!config.output_shared) {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".part-%05d", my_rank);
+        string path = base + suffix;
+        FILE* out = fopen(path.c_str(), "wb");
+        if (!out) {
+            cerr << "Erro ao abrir arquivo: " << path << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        string chunk;
+        if (binary) append_binary_header(chunk, N, total_ngrams);
+        size_t pos = 0;
+        do {
+            fwrite(chunk.data(), 1, chunk.size(), out);
+            pos = formatChunk(entries, pos, total_ngrams, config.output_format, chunk);
+        } while (!chunk.empty());
+        if (fclose(out) != 0) {
+            cerr << "Erro ao gravar arquivo: " << path << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        return;
+    }
+
+    // Arquivo compartilhado: a parte de cada processo é formatada inteira
+    // antes, porque o deslocamento depende do tamanho das anteriores
+    string formatted;
+    if (binary && my_rank == 0) append_binary_header(formatted, N, total_ngrams);
+    format_results(entries, 0, entries.size(), config.output_format, total_ngrams, formatted);
+
+    long long len = formatted.size(), offset = 0, file_size = 0;
+    MPI_Exscan(&len, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&len, &file_size, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (my_rank == 0) offset = 0; // O Exscan deixa o valor da raiz indefinido
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, base.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (my_rank == 0) cerr << "Erro ao abrir arquivo: " << base << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_File_set_size(fh, file_size); // Trunca o que sobrar de um arquivo antigo maior
+    writeFileAt(fh, offset, formatted.data(), formatted.size());
+    MPI_File_close(&fh);
+}
+
+/**
+ * Emite os n-gramas significativos de um N, que estão espalhados entre os
+ * processos em `entries`: aplica --top ou --sort, imprime (--print) e grava
+ * (--output). Na impressão, a raiz escreve a sua parte e depois a de cada
+ * processo, em ordem de rank, recebendo pedaços de RESULT_CHUNK_BYTES já
+ * formatados; a formatação é feita em paralelo e a raiz nunca guarda mais
+ * que um pedaço alheio. Nos arquivos, cada processo grava a sua parte.
+ */
+void emitResults(vector<ResultEntry>& entries, int N, long long total_ngrams, int my_rank, int nprocs) {
+    // O total só é certo na raiz em alguns modos, e as frequências dependem dele
+    MPI_Bcast(&total_ngrams, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    if (config.top_k > 0) {
+        selectTopK(entries, my_rank, nprocs);
+    } else if (config.order != ORDER_NONE) {
+        sortResults(entries, config.order, nprocs);
+    }
+
+    if (config.print_ngrams) {
+        PhaseTimer timer(PH_OUTPUT);
+        string chunk;
+        size_t pos = 0;
+        if (my_rank == 0) {
+            printNgramsHeader(N);
+            do {
+                pos = formatChunk(entries, pos, total_ngrams, FORMAT_TEXT, chunk);
+                cout.write(chunk.data(), chunk.size());
+            } while (!chunk.empty());
+            for (int p = 1; p < nprocs; p++) {
+                do {
+                    MPI_Status status;
+                    MPI_Probe(p, TAG_RESULTS, MPI_COMM_WORLD, &status);
+                    chunk.resize(messageBytes(status));
+                    MPI_Datatype type = bytesType(chunk.size());
+                    MPI_Recv(&chunk[0], 1, type, p, TAG_RESULTS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                    MPI_Type_free(&type);
+                    cout.write(chunk.data(), chunk.size());
+                } while (!chunk.empty());
+            }
+            cout << flush;
+        } else {
+            // Uma mensagem vazia marca o fim
+            do {
+                pos = formatChunk(entries, pos, total_ngrams, FORMAT_TEXT, chunk);
+                sendBytes(chunk.data(), chunk.size(), 0, TAG_RESULTS);
+            } while (!chunk.empty());
+        }
+    }
+
+    if (!config.output_path.empty()) writeResults(entries, N, total_ngrams, my_rank);
+}
+
+// --- Snapshot persistente (--snapshot, --update; ver snapshot.h) ---
+
+// O valor de --normalize de um modo, como fica no manifest
+const char* normalizeOption(int mode) {
+    switch (mode) {
+        case NORM_ASCII: return "ascii";
+        case NORM_UTF8_STRIP: return "strip";
+        default: return "utf8";
+    }
+}
+
+// Erros do snapshot param todos os processos; a mensagem sai por quem a viu
+void snapshotError(const string& error) {
+    cerr << "Snapshot: " << error << endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+/**
+ * Lê a versão atual do snapshot (todos os processos leem o manifest) e, com
+ * --update, confere se ela foi contada com os mesmos N e a mesma
+ * normalização e tira das entradas os arquivos que ela já contém. Devolve
+ * quantos foram tirados.
+ */
+size_t openSnapshot(int my_rank, SnapshotManifest& manifest) {
+    string error;
+    if (!read_snapshot(config.snapshot_dir, manifest, error)) {
+        if (my_rank == 0) snapshotError(error);
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+    if (!(config.update || config.compact) || manifest.version == 0) return 0;
+
+    if (manifest.ns != config.ns || manifest.normalization != normalizeOption(config.normalization)) {
+        if (my_rank == 0) {
+            snapshotError("o snapshot em " + config.snapshot_dir + " foi contado com outros N ou outra normalização");
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+    vector<string> fresh;
+    for (size_t f = 0; f < config.inputs.size(); f++) {
+        if (!manifest.has_input(canonical_path(config.inputs[f]))) fresh.push_back(config.inputs[f]);
+    }
+    size_t skipped = config.inputs.size() - fresh.size();
+    config.inputs = fresh;
+    return skipped;
+}
+
+// Cria (vazio) o diretório da camada `layer` antes de qualquer processo gravar nele
+void createLayer(long long layer, int my_rank) {
+    if (my_rank == 0) {
+        string dir = snapshot_layer_dir(config.snapshot_dir, layer);
+        mkdir(config.snapshot_dir.c_str(), 0777); // O primeiro snapshot cria o diretório
+        remove_tree(dir); // Restos de uma atualização interrompida
+        if (mkdir(dir.c_str(), 0777) != 0) snapshotError("erro ao criar " + dir + ": " + strerror(errno));
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+// Soma em `counts` os segmentos de N do snapshot, divididos entre os processos
+void loadSnapshot(const SnapshotManifest& manifest, int N, int my_rank, int nprocs, NgramCounts& counts) {
+    PhaseTimer timer(PH_READ);
+    vector<string> segments = snapshot_segments(config.snapshot_dir, manifest, N);
+    string error;
+    for (size_t k = my_rank; k < segments.size(); k += nprocs) {
+        long long bytes = load_segment(segments[k], counts, error);
+        if (bytes < 0) snapshotError(error);
+        profile.count(CT_BYTES_READ, bytes);
+    }
+}
+
+// Grava as contagens deste processo como o seu segmento de N na camada
+void writeSegment(long long layer, int N, int my_rank, const NgramCounts& counts) {
+    PhaseTimer timer(PH_OUTPUT);
+    string error;
+    if (!write_segment(snapshot_segment_path(config.snapshot_dir, layer, N, my_rank), counts, error)) {
+        snapshotError(error);
+    }
+}
+
+/**
+ * Torna `next` a versão atual, depois que todos os processos gravaram os
+ * seus segmentos, e apaga as versões que deixaram de ser necessárias.
+ */
+void commitSnapshot(const SnapshotManifest& previous, const SnapshotManifest& next, int my_rank) {
+    PhaseTimer timer(PH_COLLECTIVE);
+    MPI_Barrier(MPI_COMM_WORLD);
+    timer.stop();
+    if (my_rank != 0) return;
+    PhaseTimer output_timer(PH_OUTPUT);
+    string error;
+    sync_dir(snapshot_layer_dir(config.snapshot_dir, next.version));
+    if (!commit_snapshot(config.snapshot_dir, next, error)) snapshotError(error);
+    collect_snapshot_garbage(config.snapshot_dir, next, previous);
+}
+
+// --- Instrumentação ---
+
+/**
+ * Junta na raiz os números de instrument.h de todos os processos. Com
+ * --stats, imprime mínimo, média e máximo de cada um entre os processos (e
+ * máximo/média, que mede o desequilíbrio); com --trace, grava os eventos de
+ * todos num único arquivo do Chrome trace, um "processo" por rank.
+ */
+void reportProfile(int my_rank, int nprocs) {
+    vector<double> mine = profile.values();
+    int n = mine.size();
+    vector<double> all(my_rank == 0 ? (size_t)n * nprocs : 1);
+    MPI_Gather(&mine[0], n, MPI_DOUBLE, &all[0], n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (config.stats && my_rank == 0) {
+        cout << "\n--- Perfil por processo (" << nprocs << " processos) ---\n";
+        cout << left << setw(26) << "" << right << setw(15) << "mín" << setw(15) << "média" << setw(15) << "máx"
+             << setw(12) << "máx/méd" << setw(8) << "rank" << "\n";
+        for (int i = 0; i < n; i++) {
+            double lo = all[i], hi = all[i], sum = 0;
+            int hi_rank = 0;
+            for (int p = 0; p < nprocs; p++) {
+                double v = all[(size_t)p * n + i];
+                lo = min(lo, v);
+                if (v > hi) hi = v, hi_rank = p;
+                sum += v;
+            }
+            if (hi == 0) continue; // Fases que não aconteceram neste modo
+            double mean = sum / nprocs;
+            int precision = (i < NUM_PHASES) ? 4 : (i < NUM_PHASES + NUM_COUNTERS) ? 0 : 2;
+            // setw conta bytes, e os nomes têm acentos em UTF-8
+            string name = Profile::value_name(i);
+            size_t extra = 0;
+            for (size_t c = 0; c < name.length(); c++) extra += ((name[c] & 0xC0) == 0x80);
+            cout << left << setw(26 + extra) << name << right << fixed << setprecision(precision)
+                 << setw(14) << lo << setw(14) << mean << setw(14) << hi
+                 << setprecision(2) << setw(10) << (mean > 0 ? hi / mean : 0) << setw(8) << hi_rank << "\n";
+        }
+    }
+
+    if (config.trace_path.empty()) return;
+    string events = profile.trace_events(my_rank);
+    vector<size_t> lens, offs;
+    vector<char> buffer;
+    gatherBytes(events, 0, buffer, lens, offs);
+    if (my_rank != 0) return;
+
+    ofstream trace(config.trace_path.c_str());
+    if (!trace.is_open()) {
+        cerr << "Erro ao abrir arquivo: " << config.trace_path << endl;
+        return;
+    }
+    trace << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (int p = 0; p < nprocs; p++) {
+        if (p > 0) trace << ",\n";
+        trace.write(&buffer[offs[p]], lens[p]);
+    }
+    trace << "\n]}\n";
+}
+
+// --- LÓGICA PRINCIPAL MODIFICADA ---
+
+int ngram_parallel() {
+
+    int my_rank, nprocs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    // Com --stats/--trace, todos partem juntos, para as linhas do tempo se alinharem
+    if (config.stats || !config.trace_path.empty()) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        profile.start(!config.trace_path.empty());
+    }
+
+    double start_time = MPI_Wtime();
+
+    // Snapshot: com --update, só as entradas novas são contadas e viram uma
+    // camada nova; as contagens antigas só são lidas se for preciso emitir
+    // resultados ou compactar
+    SnapshotManifest previous, next;
+    size_t total_inputs = config.inputs.size(), skipped_inputs = 0;
+    bool use_snapshot = !config.snapshot_dir.empty();
+    bool incremental = false, compact = false, merge_old = false, new_layer = false;
+    if (use_snapshot) {
+        skipped_inputs = openSnapshot(my_rank, previous);
+        incremental = (config.update || config.compact) && previous.version > 0;
+        compact = incremental && (config.compact || previous.layers.size() + 1 > SNAPSHOT_MAX_LAYERS);
+        merge_old = incremental && (compact || wantResults());
+        // Uma atualização sem arquivos novos só consulta o snapshot
+        new_layer = !incremental || compact || !config.inputs.empty();
+
+        next = previous;
+        if (new_layer) {
+            next.version = previous.version + 1;
+            next.normalization = normalizeOption(config.normalization);
+            next.ns = config.ns;
+            next.totals.assign(config.ns.size(), 0);
+            if (!incremental || compact) next.layers.clear();
+            next.layers.push_back(SnapshotLayer{ next.version, nprocs });
+            if (!incremental) next.inputs.clear();
+            for (size_t f = 0; f < config.inputs.size(); f++) next.inputs.push_back(canonical_path(config.inputs[f]));
+            createLayer(next.version, my_rank);
+        } else if (my_rank == 0) {
+            cout << "Nenhuma entrada nova; o snapshot não muda" << endl;
+        }
+    }
+
+    NgramCountSet ngramCounts(config.ns);
+
+    // Modo de memória limitada (--memory): as contagens vão para runs em
+    // disco, uma sequência de runs por N. As reduções são feitas uma de cada
+    // vez, então cada uma pode usar o orçamento inteiro.
+    vector<unique_ptr<RunSpiller> > spillers;
+    for (size_t i = 0; config.memory_bytes > 0 && i < config.ns.size(); i++) {
+        string prefix = "ngrams-" + to_string(getpid()) + "-r" + to_string(my_rank) + "-n" + to_string(config.ns[i]);
+        spillers.push_back(unique_ptr<RunSpiller>(new RunSpiller(config.spill_dir, prefix, config.memory_bytes)));
+    }
+
+    // --- 1. Leitura e contagem local, arquivo por arquivo ---
+    for (size_t f = 0; f < config.inputs.size(); f++) {
+        const char* path = config.inputs[f].c_str();
+        if (config.read_mode == READ_BLOCKS) {
+            // Cada processo pega blocos de tamanho fixo até acabarem
+            countDynamicBlocks(path, my_rank, config.threads, ngramCounts, spillers);
+        } else if (config.read_mode == READ_RANGES) {
+            // Cada processo lê e conta a própria faixa
+            countOwnRange(path, my_rank, nprocs, config.threads, ngramCounts, spillers);
+        } else {
+            distributeText(path, my_rank, nprocs, config.threads, ngramCounts);
+        }
+    }
+    profile.record_tables(ngramCounts);
+    maybeSpill(ngramCounts, spillers, true);
+
+    // --- 2. Redução, um N de cada vez ---
+    vector<long long> all_stats(3 * config.ns.size(), 0);
+    for (size_t i = 0; i < config.ns.size(); i++) {
+        long long* global_stats = &all_stats[3 * i];
+        vector<ResultEntry> results;
+        if (!spillers.empty()) {
+            reduceStreaming(*spillers[i], config.ns[i], my_rank, nprocs, global_stats, results);
+            spillers[i].reset(); // Apaga as runs deste N
+        } else if (incremental && !merge_old) {
+            // Atualização sem leitura do snapshot: a camada nova é o delta
+            // deste processo, sem redução, e só o total é conhecido
+            NgramCounts counts = ngramCounts.release(i);
+            if (new_layer) writeSegment(next.version, config.ns[i], my_rank, counts);
+            long long delta = countTotalNgrams(counts);
+            MPI_Allreduce(&delta, &global_stats[0], 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+            global_stats[0] += previous.totals[i];
+            global_stats[1] = global_stats[2] = -1;
+        } else {
+            NgramCounts counts = ngramCounts.release(i);
+            if (incremental && !compact && new_layer) writeSegment(next.version, config.ns[i], my_rank, counts);
+            if (merge_old) loadSnapshot(previous, config.ns[i], my_rank, nprocs, counts);
+            reduceCounts(counts, my_rank, nprocs, TAG_MAP + (int)i, global_stats, results);
+            // Snapshot novo ou compactado: cada processo grava o que ficou com ele depois da redução
+            if (use_snapshot && (!incremental || compact)) writeSegment(next.version, config.ns[i], my_rank, counts);
+        }
+        if (use_snapshot) next.totals[i] = global_stats[0];
+        if (wantResults()) emitResults(results, config.ns[i], global_stats[0], my_rank, nprocs);
+    }
+    if (new_layer) commitSnapshot(previous, next, my_rank);
+
+    // --- 3. Resumo na raiz ---
+    if (my_rank == 0) {
         double end_time = MPI_Wtime();
         double elapsed_time = end_time - start_time;
         
-        //printNgrams(ngramCounts, MIN_THRESHOLD); // Descomente se quiser ver os n-gramas
-        
         cout << "\n===========================================\n";
         cout << "Tempo total de execução: " << elapsed_time << " segundos\n";
         cout << "Número de processos: " << nprocs << endl;
-        cout << "Char Threshold: " << CHAR_THRESHOLD << endl;
+        cout << "Threads por processo: " << config.threads << endl;
+        cout << "Entradas: " << total_inputs << (total_inputs == 1 ? " arquivo" : " arquivos");
+        if (skipped_inputs > 0) cout << " (" << skipped_inputs << " já no snapshot)";
+        cout << endl;
+        if (use_snapshot) {
+            cout << "Snapshot: " << config.snapshot_dir << ", versão " << next.version << " com " << next.layers.size()
+                 << (next.layers.size() == 1 ? " camada" : " camadas")
+                 << (compact ? " (compactado)" : !new_layer ? " (sem mudanças)" : incremental ? " (atualizado)" : "") << endl;
+        }
+        cout << "Leitura: " << read_mode_name(config.read_mode) << endl;
+        cout << "Redução: " << (config.memory_bytes > 0 ? "all-to-all por hash, em fases a partir do disco"
+                                : config.reduction == REDUCE_SHUFFLE ? "all-to-all por hash"
+                                : config.reduction == REDUCE_SKETCH ? (config.sketch_verify ? "resumos (Count-Min + Space-Saving), verificada"
+                                                                                            : "resumos (Count-Min + Space-Saving), aproximada")
+                                : config.reduction == REDUCE_NODE ? "memória compartilhada no nó, árvore entre os nós"
+                                : "árvore") << endl;
+        if (config.memory_bytes > 0) cout << "Orçamento de memória: " << config.memory_bytes / (1 << 20) << " MB por processo\n";
+        cout << "Char Threshold: " << config.char_threshold << endl;
+        cout << "Contagem local: " << (config.engine == ENGINE_SORT ? "radix sort" : "tabela hash") << endl;
+        cout << "Tokenizador: " << tokenizer_name(TOKENIZER) << ", " << norm_mode_name(config.normalization) << endl;
+        for (size_t i = 0; i < config.ns.size(); i++) {
+            const long long* global_stats = &all_stats[3 * i];
+            cout << "N-gramas";
+            if (config.ns.size() > 1) cout << " (N = " << config.ns[i] << ")";
+            cout << ": " << global_stats[0];
+            if (global_stats[2] >= 0) {
+                cout << " (";
+                if (global_stats[1] >= 0) cout << global_stats[1] << " únicos, ";
+                cout << global_stats[2] << " com contagem >= " << config.min_threshold << ")";
+            }
+            cout << "\n";
+        }
         cout << "===========================================\n";
     }
+    if (profile.enabled()) reportProfile(my_rank, nprocs);
 
     MPI_Finalize();
     return 0;
 }
 
 
-int main() {
+int main(int argc, char** argv) {
+    // As threads não chamam MPI; só a thread principal se comunica
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    int my_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    bool help;
+    string error;
+    bool ok = parseCommandLine(argc, argv, config, help, error);
+    if (ok && config.memory_bytes > 0 && config.read_mode == READ_TREE) {
+        // Na distribuição pela árvore o Rank 0 guarda o arquivo inteiro
+        error = "--memory requer --read ranges ou --read blocks";
+        ok = false;
+    }
+    if (ok && !config.snapshot_dir.empty() &&
+        (config.memory_bytes > 0 || config.prefilter || config.reduction == REDUCE_SKETCH)) {
+        // O snapshot guarda as contagens exatas de todos os n-gramas
+        error = "--snapshot não funciona com --memory, --prefilter ou --reduce sketch";
+        ok = false;
+    }
+    if (ok && config.output_format == FORMAT_LOOKUP) {
+        // O arquivo de consulta é sempre um só, em ordem de n-grama
+        if (config.order == ORDER_COUNT) {
+            error = "--format lookup requer a ordem de n-grama (--sort ngram, o padrão com esse formato)";
+            ok = false;
+        }
+        config.order = ORDER_NGRAM;
+    }
+    if (ok && (config.update || config.compact) && config.snapshot_dir.empty()) {
+        error = "--update e --compact requerem --snapshot";
+        ok = false;
+    }
+    if (ok && config.threads > 1 && provided < MPI_THREAD_FUNNELED) {
+        // Sem MPI_THREAD_FUNNELED, nem as threads que não chamam MPI são garantidas
+        if (my_rank == 0) cerr << "Aviso: a biblioteca MPI não oferece MPI_THREAD_FUNNELED; usando --threads 1" << endl;
+        config.threads = 1;
+    }
+    if (help || !ok) {
+        if (my_rank == 0) {
+            if (!ok) cerr << error << "\n\n" << usage();
+            else cout << usage();
+        }
+        if (!ok) MPI_Abort(MPI_COMM_WORLD, 1);
+        MPI_Finalize();
+        return 0;
+    }
+
     ngram_parallel();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,100 @@
+// Consultas a um arquivo de consulta (parallel --format lookup, ver lookup.h).
+//
+// Uso: ./query [opções] ARQUIVO [CONSULTA...]
+//      Sem consultas na linha de comando, lê uma por linha da entrada padrão.
+//      As consultas são normalizadas como o texto foi na contagem.
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <iostream>
+#include <string>
+#include "lookup.h"
+
+using namespace std;
+
+static const char* usage =
+    "Uso: query [opções] ARQUIVO [CONSULTA...]\n"
+    "  Sem CONSULTA, lê uma por linha da entrada padrão. Cada resultado sai como\n"
+    "  \"w1 ... wN\\tcontagem\\tfrequência\" (contagem 0: o n-grama não está no arquivo).\n"
+    "\n"
+    "  -p, --prefix      cada consulta são as primeiras palavras: lista os n-gramas que começam com elas\n"
+    "  -l, --limit K     no máximo K n-gramas por prefixo, os primeiros em ordem de texto (padrão 20; 0: todos)\n"
+    "  -i, --info        mostra N, a normalização e os tamanhos do arquivo\n"
+    "  -h, --help        esta ajuda\n";
+
+static void print_entry(const NgramLookup& lookup, string_view text, uint32_t count) {
+    double freq = lookup.total() > 0 ? (double)count / lookup.total() : 0.0;
+    cout << text << '\t' << count << '\t' << freq << '\n';
+}
+
+static void run_query(const NgramLookup& lookup, const string& query, bool prefix, size_t limit) {
+    string words = normalize_query(query, lookup.normalization());
+    if (words.empty()) return;
+    if (!prefix) {
+        print_entry(lookup, words, lookup.find(words));
+        return;
+    }
+    pair<size_t, size_t> range = lookup.prefix_range(words);
+    size_t last = (limit > 0 && range.second - range.first > limit) ? range.first + limit : range.second;
+    for (size_t i = range.first; i < last; i++) print_entry(lookup, lookup.key(i), lookup.count(i));
+}
+
+int main(int argc, char** argv) {
+    bool prefix = false, info = false;
+    size_t limit = 20;
+    static const struct option options[] = {
+        { "prefix", no_argument, NULL, 'p' },
+        { "limit", required_argument, NULL, 'l' },
+        { "info", no_argument, NULL, 'i' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "pl:ih", options, NULL)) != -1) {
+        switch (opt) {
+            case 'p': prefix = true; break;
+            case 'l': {
+                char* end;
+                errno = 0;
+                limit = strtoull(optarg, &end, 10);
+                if (!isdigit((unsigned char)optarg[0]) || errno != 0 || *end != '\0') {
+                    cerr << "Valor inválido para --limit: " << optarg << "\n" << usage;
+                    return 1;
+                }
+                break;
+            }
+            case 'i': info = true; break;
+            case 'h': cout << usage; return 0;
+            default: cerr << usage; return 1;
+        }
+    }
+    if (optind >= argc) {
+        cerr << usage;
+        return 1;
+    }
+
+    NgramLookup lookup;
+    string error;
+    cout.precision(8);
+    if (!lookup.open(argv[optind], error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    if (info) {
+        static const char* modes[] = { "ascii", "utf8", "strip" };
+        cout << "N: " << lookup.n() << "\n"
+             << "Normalização: " << (lookup.normalization() < 3 ? modes[lookup.normalization()] : "?") << "\n"
+             << "N-gramas no arquivo: " << lookup.size() << "\n"
+             << "Total contado: " << lookup.total() << "\n";
+    }
+
+    if (optind + 1 < argc) {
+        for (int a = optind + 1; a < argc; a++) run_query(lookup, argv[a], prefix, limit);
+    } else if (!info) {
+        string line;
+        while (getline(cin, line)) run_query(lookup, line, prefix, limit);
+    }
+    return 0;
+}
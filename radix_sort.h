@@ -0,0 +1,166 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+/*
+ * Contagem por ordenação, comum ao ngrams.c e ao parallel.cpp (C e C++).
+ *
+ * Cada n-grama vira uma chave de largura fixa: os N ids das palavras, com
+ * `bits` bits cada, empacotados num inteiro de `words` palavras de 64 bits
+ * (a mais significativa primeiro), a primeira palavra do n-grama nos bits
+ * mais altos. As chaves ficam lado a lado num único vetor, são ordenadas por
+ * radix sort LSD (um dígito de 8 bits por passada, estável) e os n-gramas
+ * iguais ficam em sequência, contados numa varredura linear.
+ *
+ * Comparar chaves é comparar as tuplas de ids em ordem lexicográfica; se os
+ * ids seguem a ordem das palavras, é também a ordem do texto do n-grama
+ * (as palavras não têm bytes menores que o espaço que as separa).
+ *
+ * Passadas em que todas as chaves têm o mesmo dígito são puladas. Com mais
+ * de uma thread, cada passada é dividida em faixas contíguas de chaves:
+ * histogramas por faixa, somas prefixas por (dígito, faixa) e distribuição
+ * em paralelo, o que mantém a ordenação estável.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Bits necessários para ids em [0, count) (pelo menos 1) */
+static inline int radix_id_bits(size_t count) {
+    int bits = 1;
+    while (bits < 32 && ((size_t)1 << bits) < count) bits++;
+    return bits;
+}
+
+/* Palavras de 64 bits de uma chave de n ids com `bits` bits cada */
+static inline int radix_key_words(int n, int bits) {
+    return (n * bits + 63) / 64;
+}
+
+/* Escreve em key (words palavras, zeradas aqui) os ids[0..n) */
+static inline void radix_pack(uint64_t *key, int words, const uint32_t *ids, int n, int bits) {
+    memset(key, 0, words * sizeof(uint64_t));
+    for (int j = 0; j < n; j++) {
+        int pos = bits * (n - 1 - j); /* a partir do bit menos significativo */
+        int w = words - 1 - pos / 64, shift = pos % 64;
+        key[w] |= (uint64_t)ids[j] << shift;
+        if (shift + bits > 64) key[w - 1] |= (uint64_t)ids[j] >> (64 - shift);
+    }
+}
+
+/* O inverso de radix_pack */
+static inline void radix_unpack(const uint64_t *key, int words, uint32_t *ids, int n, int bits) {
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    for (int j = 0; j < n; j++) {
+        int pos = bits * (n - 1 - j);
+        int w = words - 1 - pos / 64, shift = pos % 64;
+        uint64_t v = key[w] >> shift;
+        if (shift + bits > 64) v |= key[w - 1] << (64 - shift);
+        ids[j] = (uint32_t)(v & mask);
+    }
+}
+
+/* Diz se as chaves a e b são iguais */
+static inline int radix_key_equal(const uint64_t *a, const uint64_t *b, int words) {
+    for (int w = 0; w < words; w++) {
+        if (a[w] != b[w]) return 0;
+    }
+    return 1;
+}
+
+/* Uma faixa de chaves numa passada */
+typedef struct {
+    const uint64_t *src;
+    uint64_t *dst;
+    size_t begin, end;
+    int words, word, shift;
+    size_t *count;   /* 256 contadores desta faixa; viram posições de destino */
+} RadixRange;
+
+static void *radix_histogram(void *arg) {
+    RadixRange *r = (RadixRange *)arg;
+    memset(r->count, 0, 256 * sizeof(size_t));
+    for (size_t i = r->begin; i < r->end; i++) {
+        r->count[(r->src[i * r->words + r->word] >> r->shift) & 0xFF]++;
+    }
+    return NULL;
+}
+
+static void *radix_scatter(void *arg) {
+    RadixRange *r = (RadixRange *)arg;
+    int words = r->words;
+    for (size_t i = r->begin; i < r->end; i++) {
+        const uint64_t *key = r->src + i * words;
+        size_t to = r->count[(key[r->word] >> r->shift) & 0xFF]++;
+        memcpy(r->dst + to * words, key, words * sizeof(uint64_t));
+    }
+    return NULL;
+}
+
+/* Roda fn em cada faixa, em threads a partir da segunda */
+static inline void radix_run(void *(*fn)(void *), RadixRange *ranges, int threads) {
+    pthread_t tids[64];
+    int started[64];
+    for (int t = 1; t < threads; t++) {
+        started[t] = pthread_create(&tids[t], NULL, fn, &ranges[t]) == 0;
+        if (!started[t]) fn(&ranges[t]); /* Sem thread, faz aqui mesmo */
+    }
+    fn(&ranges[0]);
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) pthread_join(tids[t], NULL);
+    }
+}
+
+/*
+ * Ordena as n chaves (words palavras cada, só os `bits` bits menos
+ * significativos em uso) de keys, usando tmp (do mesmo tamanho) como vetor
+ * auxiliar. Devolve o vetor que ficou com o resultado, keys ou tmp.
+ */
+static inline uint64_t *radix_sort_keys(uint64_t *keys, uint64_t *tmp, size_t n, int words, int bits, int threads) {
+    if (threads < 1) threads = 1;
+    if (threads > 64) threads = 64;
+    if ((size_t)threads > n / 65536 + 1) threads = (int)(n / 65536 + 1); /* Faixas pequenas não compensam */
+
+    RadixRange ranges[64];
+    size_t counts[64][256];
+    uint64_t *src = keys, *dst = tmp;
+    int passes = (bits + 7) / 8;
+    for (int d = 0; d < passes; d++) {
+        for (int t = 0; t < threads; t++) {
+            RadixRange *r = &ranges[t];
+            r->src = src;
+            r->dst = dst;
+            r->begin = n * t / threads;
+            r->end = n * (t + 1) / threads;
+            r->words = words;
+            r->word = words - 1 - (8 * d) / 64;
+            r->shift = (8 * d) % 64;
+            r->count = counts[t];
+        }
+        radix_run(radix_histogram, ranges, threads);
+
+        /* Posição de cada (dígito, faixa); pula a passada se só há um dígito */
+        size_t pos = 0;
+        int skip = 0;
+        for (int b = 0; b < 256 && !skip; b++) {
+            size_t total = 0;
+            for (int t = 0; t < threads; t++) {
+                size_t c = counts[t][b];
+                counts[t][b] = pos + total;
+                total += c;
+            }
+            skip = (total == n);
+            pos += total;
+        }
+        if (skip) continue;
+
+        radix_run(radix_scatter, ranges, threads);
+        uint64_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    return src;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "ngram_table.h"
+
+/**
+ * Resumos de tamanho fixo para o modo aproximado (--reduce sketch) e para o
+ * filtro de limiar (--prefilter). Todos são indexados pelo hash misturado da
+ * NgramTable, que depende só do texto, então os resumos de processos
+ * diferentes podem ser somados diretamente.
+ */
+
+/**
+ * Count-Min: depth linhas de width contadores. A estimativa de um n-grama é o
+ * menor dos seus depth contadores; ela nunca é menor que a contagem real e,
+ * com probabilidade 1 - delta, passa dela no máximo epsilon * total.
+ * Somar dois sketches contador a contador (MPI_SUM) dá o sketch da união.
+ */
+class CountMinSketch {
+public:
+    CountMinSketch(double epsilon, double delta) {
+        size_t w = 1;
+        while (w < (size_t)ceil(M_E / epsilon)) w *= 2; // Potência de 2: a linha sai com uma máscara
+        width = w;
+        depth = std::max(1, (int)ceil(log(1.0 / delta)));
+        counters.assign(width * depth, 0);
+    }
+
+    size_t size() const { return counters.size(); }
+    uint32_t* data() { return &counters[0]; }
+
+    void add(uint64_t hash, uint32_t count) {
+        for (int r = 0; r < depth; r++) counters[r * width + column(hash, r)] += count;
+    }
+
+    uint32_t estimate(uint64_t hash) const {
+        uint32_t best = UINT32_MAX;
+        for (int r = 0; r < depth; r++) best = std::min(best, counters[r * width + column(hash, r)]);
+        return best;
+    }
+
+private:
+    size_t column(uint64_t hash, int row) const {
+        // Uma função de hash por linha, derivada do mesmo hash de 64 bits
+        return mix_hash(hash + (uint64_t)(row + 1) * 0x9E3779B97F4A7C15ULL) & (width - 1);
+    }
+
+    size_t width;
+    int depth;
+    std::vector<uint32_t> counters;
+};
+
+/**
+ * Count-Min para o filtro de limiar (--prefilter): só interessa saber se a
+ * estimativa chega ao limiar T, então cada contador satura em T (até 255) e
+ * tem só os bits necessários para isso: 1 para T = 1, 2 para T <= 3, 4 para
+ * T <= 15 e 8 acima. Os contadores ficam empacotados em bytes, e dois sketches
+ * se juntam com saturating_add, campo a campo.
+ */
+class ThresholdSketch {
+public:
+    ThresholdSketch(size_t width, int depth, uint32_t threshold)
+        : width(std::max<size_t>(width, 1)), depth(depth), bits(bits_for(threshold)), limit(limit_for(threshold)) {
+        counters.assign((this->width * depth * bits + 7) / 8, 0);
+    }
+
+    // Bits de um contador que conta até limit_for(threshold)
+    static int bits_for(uint32_t threshold) {
+        int b = 1;
+        while (b < 8 && (1u << b) - 1 < limit_for(threshold)) b *= 2;
+        return b;
+    }
+
+    static uint32_t limit_for(uint32_t threshold) { return std::min<uint32_t>(std::max<uint32_t>(threshold, 1), 255); }
+
+    size_t size() const { return counters.size(); }
+    uint8_t* data() { return &counters[0]; }
+
+    void add(uint64_t hash, uint32_t count) {
+        for (int r = 0; r < depth; r++) {
+            size_t i = r * width + column(hash, r);
+            set(i, std::min(limit, get(i) + std::min(count, limit)));
+        }
+    }
+
+    // Falso só se a contagem total certamente fica abaixo do limiar
+    bool may_reach(uint64_t hash) const {
+        for (int r = 0; r < depth; r++) {
+            if (get(r * width + column(hash, r)) < limit) return false;
+        }
+        return true;
+    }
+
+    static void saturating_add(const uint8_t* src, uint8_t* dest, size_t len, uint32_t threshold) {
+        int b = bits_for(threshold);
+        uint32_t lim = limit_for(threshold), mask = (1u << b) - 1;
+        for (size_t i = 0; i < len; i++) {
+            if (src[i] == 0) continue;
+            uint32_t out = 0;
+            for (int shift = 0; shift < 8; shift += b) {
+                uint32_t sum = ((src[i] >> shift) & mask) + ((dest[i] >> shift) & mask);
+                out |= std::min(sum, lim) << shift;
+            }
+            dest[i] = (uint8_t)out;
+        }
+    }
+
+private:
+    // Coluna em [0, width) sem exigir potência de 2: (32 bits do hash * width) >> 32
+    size_t column(uint64_t hash, int row) const {
+        uint64_t h = mix_hash(hash + (uint64_t)(row + 1) * 0x9E3779B97F4A7C15ULL);
+        return (size_t)(((h >> 32) * width) >> 32);
+    }
+
+    uint32_t get(size_t i) const { return (counters[i * bits / 8] >> (i * bits % 8)) & ((1u << bits) - 1); }
+
+    void set(size_t i, uint32_t v) {
+        uint8_t& byte = counters[i * bits / 8];
+        int shift = i * bits % 8;
+        byte = (uint8_t)((byte & ~(((1u << bits) - 1) << shift)) | (v << shift));
+    }
+
+    size_t width;
+    int depth;
+    int bits;
+    uint32_t limit;
+    std::vector<uint8_t> counters;
+};
+
+/**
+ * Resumo Space-Saving dos k n-gramas mais frequentes, juntável (Agarwal et
+ * al., "Mergeable Summaries"). Cada entrada guarda uma contagem que é limite
+ * superior da real e o erro máximo dessa contagem. Um n-grama fora de um
+ * resumo cheio pode ter até min_count() ocorrências.
+ *
+ * As entradas têm tamanho fixo para que o resumo inteiro seja um vetor
+ * reduzido por um MPI_Op; entradas vazias têm count == 0.
+ */
+struct HeavyHitter {
+    uint64_t hash;
+    uint64_t count;
+    uint64_t error;
+};
+
+class HeavyHitters {
+public:
+    explicit HeavyHitters(size_t k) : entries(k) {
+        for (size_t i = 0; i < k; i++) entries[i].hash = entries[i].count = entries[i].error = 0;
+    }
+
+    size_t capacity() const { return entries.size(); }
+    HeavyHitter* data() { return &entries[0]; }
+    const HeavyHitter& operator[](size_t i) const { return entries[i]; }
+
+    // Resumo exato de uma tabela local: os k n-gramas mais frequentes, sem erro
+    void build(const NgramTable& table) {
+        std::vector<uint32_t> order(table.size());
+        for (size_t e = 0; e < order.size(); e++) order[e] = (uint32_t)e;
+        size_t k = std::min(order.size(), entries.size());
+        std::nth_element(order.begin(), order.begin() + k, order.end(),
+                         [&](uint32_t a, uint32_t b) { return table.count(a) > table.count(b); });
+        for (size_t i = 0; i < entries.size(); i++) {
+            HeavyHitter h = { 0, 0, 0 };
+            if (i < k) h.hash = table.hash(order[i]), h.count = table.count(order[i]);
+            entries[i] = h;
+        }
+    }
+
+    // Limite para um n-grama ausente: 0 se o resumo não está cheio
+    static uint64_t min_count(const HeavyHitter* hh, size_t k) {
+        uint64_t m = UINT64_MAX;
+        for (size_t i = 0; i < k; i++) {
+            if (hh[i].count == 0) return 0;
+            m = std::min(m, hh[i].count);
+        }
+        return k > 0 ? m : 0;
+    }
+
+    /**
+     * dest = junção de src e dest, os dois com k entradas. Quem falta num
+     * resumo herda dele a contagem min_count() (e o mesmo valor de erro);
+     * ficam as k maiores contagens resultantes.
+     */
+    static void merge(const HeavyHitter* src, HeavyHitter* dest, size_t k) {
+        uint64_t min_src = min_count(src, k), min_dest = min_count(dest, k);
+        std::unordered_map<uint64_t, HeavyHitter> all;
+        all.reserve(2 * k);
+        for (size_t i = 0; i < k; i++) {
+            if (dest[i].count == 0) continue;
+            HeavyHitter h = dest[i];
+            h.count += min_src;
+            h.error += min_src;
+            all[h.hash] = h;
+        }
+        for (size_t i = 0; i < k; i++) {
+            if (src[i].count == 0) continue;
+            auto it = all.find(src[i].hash);
+            if (it != all.end()) {
+                // Estava nos dois: troca o limite min_src pela contagem de src
+                it->second.count += src[i].count - min_src;
+                it->second.error += src[i].error - min_src;
+            } else {
+                HeavyHitter h = src[i];
+                h.count += min_dest;
+                h.error += min_dest;
+                all[h.hash] = h;
+            }
+        }
+        std::vector<HeavyHitter> merged;
+        merged.reserve(all.size());
+        for (auto it = all.begin(); it != all.end(); ++it) merged.push_back(it->second);
+        size_t keep = std::min(k, merged.size());
+        std::nth_element(merged.begin(), merged.begin() + keep, merged.end(),
+                         [](const HeavyHitter& a, const HeavyHitter& b) { return a.count > b.count; });
+        for (size_t i = 0; i < k; i++) {
+            if (i < keep) {
+                dest[i] = merged[i];
+            } else {
+                dest[i].hash = dest[i].count = dest[i].error = 0;
+            }
+        }
+    }
+
+private:
+    std::vector<HeavyHitter> entries;
+};
+
+#endif
@@ -0,0 +1,311 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "ngram_table.h"
+#include "ngram_wire.h"
+
+/**
+ * Snapshot persistente das contagens (--snapshot DIR), que --update estende
+ * com novos documentos sem recontar o corpus.
+ *
+ * Um diretório de snapshot tem:
+ *   CURRENT            o número da versão atual; trocado com rename, então
+ *                      uma atualização interrompida deixa a versão anterior
+ *   vNNNNNN.manifest   uma versão: Ns, normalização, total de cada N, as
+ *                      camadas que a compõem e os arquivos já contados
+ *   layer-NNNNNN/      uma camada, criada pela versão NNNNNN: um segmento
+ *                      nN.rRRRRR por N e por processo que a gravou
+ *
+ * Um segmento é uma sequência de mensagens no formato de ngram_wire.h (com o
+ * próprio vocabulário); as contagens de uma versão são a soma das contagens
+ * de todos os segmentos das suas camadas. Uma atualização só grava uma
+ * camada nova, com as contagens dos arquivos novos, e uma versão que aponta
+ * para as camadas antigas mais a nova: o custo é o do delta. A compactação
+ * (--compact, ou quando as camadas passam de SNAPSHOT_MAX_LAYERS) junta
+ * tudo numa camada só.
+ *
+ * Ficam a versão atual e a anterior (para voltar atrás, basta editar
+ * CURRENT); manifests e camadas mais antigos são apagados.
+ */
+
+const char SNAPSHOT_FORMAT[] = "ngram-snapshot";
+const int SNAPSHOT_FORMAT_VERSION = 1;
+const size_t SNAPSHOT_MAX_LAYERS = 8;
+
+// Entradas por mensagem num segmento: limita a memória da serialização
+const size_t SNAPSHOT_ENTRIES_PER_MESSAGE = 1 << 20;
+
+struct SnapshotLayer {
+    long long id;  // Versão que criou a camada
+    int ranks;     // Processos que a gravaram (um segmento por N e por processo)
+};
+
+struct SnapshotManifest {
+    long long version;                        // 0: o diretório ainda não tem snapshot
+    std::string normalization;
+    std::vector<int> ns;
+    std::vector<unsigned long long> totals;   // Total de n-gramas de cada N, na ordem de ns
+    std::vector<SnapshotLayer> layers;
+    std::vector<std::string> inputs;          // Caminhos canônicos dos arquivos já contados
+
+    SnapshotManifest() : version(0) {}
+
+    bool has_input(const std::string& path) const {
+        return std::find(inputs.begin(), inputs.end(), path) != inputs.end();
+    }
+};
+
+inline std::string snapshot_number(long long n) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%06lld", n);
+    return buf;
+}
+
+inline std::string snapshot_manifest_path(const std::string& dir, long long version) {
+    return dir + "/v" + snapshot_number(version) + ".manifest";
+}
+
+inline std::string snapshot_layer_dir(const std::string& dir, long long layer) {
+    return dir + "/layer-" + snapshot_number(layer);
+}
+
+inline std::string snapshot_segment_path(const std::string& dir, long long layer, int N, int rank) {
+    char name[64];
+    snprintf(name, sizeof(name), "/n%d.r%05d", N, rank);
+    return snapshot_layer_dir(dir, layer) + name;
+}
+
+// Os segmentos de todas as camadas de `manifest` para um N
+inline std::vector<std::string> snapshot_segments(const std::string& dir, const SnapshotManifest& manifest, int N) {
+    std::vector<std::string> paths;
+    for (size_t l = 0; l < manifest.layers.size(); l++) {
+        for (int r = 0; r < manifest.layers[l].ranks; r++) {
+            paths.push_back(snapshot_segment_path(dir, manifest.layers[l].id, N, r));
+        }
+    }
+    return paths;
+}
+
+// Caminho absoluto sem links, para reconhecer um arquivo já contado
+inline std::string canonical_path(const std::string& path) {
+    char resolved[PATH_MAX];
+    return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+}
+
+/**
+ * Lê a versão atual de `dir`. Sem CURRENT, devolve true com version = 0.
+ */
+inline bool read_snapshot(const std::string& dir, SnapshotManifest& manifest, std::string& error) {
+    manifest = SnapshotManifest();
+    std::ifstream current((dir + "/CURRENT").c_str());
+    if (!current.is_open()) return true;
+    long long version = 0;
+    if (!(current >> version) || version <= 0) {
+        error = "snapshot inválido: " + dir + "/CURRENT";
+        return false;
+    }
+
+    std::string path = snapshot_manifest_path(dir, version);
+    std::ifstream in(path.c_str());
+    std::string format, key;
+    int format_version = 0;
+    if (!in.is_open() || !(in >> format >> format_version) || format != SNAPSHOT_FORMAT) {
+        error = "manifest inválido: " + path;
+        return false;
+    }
+    if (format_version != SNAPSHOT_FORMAT_VERSION) {
+        error = "versão de snapshot não suportada: " + path;
+        return false;
+    }
+    manifest.version = version;
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        if (!(fields >> key)) continue;
+        if (key == "normalize") {
+            fields >> manifest.normalization;
+        } else if (key == "n") {
+            int N;
+            unsigned long long total;
+            std::string label;
+            if (!(fields >> N >> label >> total) || label != "total") break;
+            manifest.ns.push_back(N);
+            manifest.totals.push_back(total);
+        } else if (key == "layer") {
+            SnapshotLayer layer;
+            std::string label;
+            if (!(fields >> layer.id >> label >> layer.ranks) || label != "ranks" || layer.ranks < 1) break;
+            manifest.layers.push_back(layer);
+        } else if (key == "input") {
+            // O caminho é o resto da linha, que pode ter espaços
+            manifest.inputs.push_back(line.substr(line.find(' ') + 1));
+        } else {
+            break;
+        }
+    }
+    if (!in.eof() || manifest.ns.empty()) {
+        error = "manifest inválido: " + path;
+        return false;
+    }
+    return true;
+}
+
+// Grava e sincroniza um arquivo com `data`; false com a mensagem em error
+inline bool write_file_synced(const std::string& path, const std::string& data, std::string& error) {
+    FILE* f = fopen(path.c_str(), "wb");
+    bool ok = f && fwrite(data.data(), 1, data.size(), f) == data.size() && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (f && fclose(f) != 0) ok = false;
+    if (!ok) error = "erro ao gravar " + path + ": " + strerror(errno);
+    return ok;
+}
+
+// Sincroniza as entradas de um diretório (arquivos criados ou renomeados nele)
+inline void sync_dir(const std::string& dir) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+/**
+ * Grava `counts` como um segmento, em mensagens de até
+ * SNAPSHOT_ENTRIES_PER_MESSAGE entradas, e o sincroniza com o disco.
+ */
+inline bool write_segment(const std::string& path, const NgramCounts& counts, std::string& error) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        error = "erro ao criar " + path + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = true;
+    std::string message;
+    std::vector<uint32_t> entries;
+    for (size_t begin = 0; begin < counts.table.size() && ok; begin += SNAPSHOT_ENTRIES_PER_MESSAGE) {
+        size_t end = std::min(counts.table.size(), begin + SNAPSHOT_ENTRIES_PER_MESSAGE);
+        entries.clear();
+        for (size_t e = begin; e < end; e++) entries.push_back((uint32_t)e);
+        message.clear();
+        serializeNgrams(counts, &entries, message);
+        ok = fwrite(message.data(), 1, message.size(), f) == message.size();
+    }
+    ok = ok && fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) error = "erro ao gravar " + path + ": " + strerror(errno);
+    return ok;
+}
+
+/**
+ * Soma em `dest` as contagens de um segmento (mapeado em memória). Devolve
+ * o tamanho lido, ou -1 com a mensagem em error.
+ */
+inline long long load_segment(const std::string& path, NgramCounts& dest, std::string& error) {
+    MappedFile segment;
+    if (mapped_file_open(&segment, path.c_str(), 1) != 0) {
+        error = "erro ao abrir " + path + ": " + strerror(errno);
+        return -1;
+    }
+    size_t pos = 0;
+    while (pos < segment.size) {
+        size_t consumed;
+        if (!mergeSerializedNgrams(segment.data + pos, segment.size - pos, dest, &consumed)) {
+            error = "segmento inválido: " + path;
+            mapped_file_close(&segment);
+            return -1;
+        }
+        pos += consumed;
+    }
+    long long size = segment.size;
+    mapped_file_close(&segment);
+    return size;
+}
+
+/**
+ * Torna `manifest` a versão atual de `dir`: grava o manifest e troca CURRENT
+ * com rename, depois de sincronizar ambos. As camadas precisam já estar
+ * gravadas e sincronizadas.
+ */
+inline bool commit_snapshot(const std::string& dir, const SnapshotManifest& manifest, std::string& error) {
+    std::ostringstream out;
+    out << SNAPSHOT_FORMAT << " " << SNAPSHOT_FORMAT_VERSION << "\n";
+    out << "normalize " << manifest.normalization << "\n";
+    for (size_t i = 0; i < manifest.ns.size(); i++) out << "n " << manifest.ns[i] << " total " << manifest.totals[i] << "\n";
+    for (size_t l = 0; l < manifest.layers.size(); l++) {
+        out << "layer " << manifest.layers[l].id << " ranks " << manifest.layers[l].ranks << "\n";
+    }
+    for (size_t i = 0; i < manifest.inputs.size(); i++) out << "input " << manifest.inputs[i] << "\n";
+
+    std::string path = snapshot_manifest_path(dir, manifest.version);
+    if (!write_file_synced(path + ".tmp", out.str(), error)) return false;
+    if (rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+        error = "erro ao renomear " + path + ": " + strerror(errno);
+        return false;
+    }
+    if (!write_file_synced(dir + "/CURRENT.tmp", std::to_string(manifest.version) + "\n", error)) return false;
+    if (rename((dir + "/CURRENT.tmp").c_str(), (dir + "/CURRENT").c_str()) != 0) {
+        error = "erro ao renomear " + dir + "/CURRENT: " + strerror(errno);
+        return false;
+    }
+    sync_dir(dir);
+    return true;
+}
+
+inline void remove_tree(const std::string& path) {
+    DIR* d = opendir(path.c_str());
+    if (d) {
+        while (struct dirent* entry = readdir(d)) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                remove((path + "/" + entry->d_name).c_str());
+            }
+        }
+        closedir(d);
+    }
+    rmdir(path.c_str());
+}
+
+/**
+ * Apaga as versões anteriores a `previous` e as camadas que nem a versão
+ * atual nem `previous` usam (inclusive as de atualizações interrompidas).
+ */
+inline void collect_snapshot_garbage(const std::string& dir, const SnapshotManifest& current,
+                                     const SnapshotManifest& previous) {
+    std::vector<long long> live;
+    for (size_t l = 0; l < current.layers.size(); l++) live.push_back(current.layers[l].id);
+    for (size_t l = 0; l < previous.layers.size(); l++) live.push_back(previous.layers[l].id);
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    std::vector<std::string> doomed;
+    while (struct dirent* entry = readdir(d)) {
+        long long n;
+        char rest[8];
+        if (sscanf(entry->d_name, "layer-%lld%1s", &n, rest) == 1) {
+            if (std::find(live.begin(), live.end(), n) == live.end()) doomed.push_back(entry->d_name);
+        } else if (sscanf(entry->d_name, "v%lld.manifes%1s", &n, rest) == 2 && rest[0] == 't') {
+            if (n < previous.version || (previous.version == 0 && n < current.version)) doomed.push_back(entry->d_name);
+        }
+    }
+    closedir(d);
+    for (size_t i = 0; i < doomed.size(); i++) {
+        std::string path = dir + "/" + doomed[i];
+        if (doomed[i].compare(0, 6, "layer-") == 0) remove_tree(path);
+        else remove(path.c_str());
+    }
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+#include "ngram_table.h"
+
+/**
+ * Contagem com memória limitada: quando a tabela passa do orçamento, ela é
+ * gravada em disco como uma "run" ordenada e esvaziada. No fim, as runs são
+ * lidas de volta em ordem por uma junção de k vias (RunMerger).
+ *
+ * Formato de uma run, registro a registro, em ordem de (hash, texto):
+ *   [u64 hash misturado] [u32 contagem] [u32 tamanho do texto] [texto "w1 w2 ... wN"]
+ *
+ * A ordem é a do hash misturado da NgramTable (igual em todos os processos),
+ * então a junção produz as faixas de hash uma após a outra e cada faixa pode
+ * ser reduzida entre os processos separadamente.
+ *
+ * Um erro de E/S (disco cheio, por exemplo) aborta o processo com uma
+ * mensagem: uma run truncada daria contagens erradas na junção.
+ */
+
+// Buffer de leitura de cada run aberta na junção
+const size_t RUN_READ_BUFFER = 1 << 16;
+// Máximo de runs abertas de uma vez, qualquer que seja o orçamento (descritores)
+const size_t MAX_MERGE_FAN_IN = 256;
+
+/**
+ * Gravação de uma run, registro a registro.
+ */
+class RunWriter {
+public:
+    explicit RunWriter(const std::string& path) : path(path), buffer(1 << 20), bytes_written(0) {
+        f = fopen(path.c_str(), "wb");
+        if (!f) fail();
+        setvbuf(f, &buffer[0], _IOFBF, buffer.size());
+    }
+
+    void write(uint64_t hash, uint32_t count, const std::string& text) {
+        uint32_t len = (uint32_t)text.length();
+        put(&hash, sizeof(hash));
+        put(&count, sizeof(count));
+        put(&len, sizeof(len));
+        put(text.data(), len);
+        bytes_written += sizeof(hash) + sizeof(count) + sizeof(len) + len;
+    }
+
+    // Fecha o arquivo, conferindo que tudo chegou ao disco; devolve os bytes gravados
+    uint64_t close() {
+        bool failed = ferror(f) != 0;
+        if (fclose(f) != 0 || failed) fail();
+        return bytes_written;
+    }
+
+private:
+    RunWriter(const RunWriter&);
+    RunWriter& operator=(const RunWriter&);
+
+    void put(const void* data, size_t len) {
+        if (len > 0 && fwrite(data, 1, len, f) != len) fail();
+    }
+
+    void fail() {
+        perror(("Erro ao gravar run " + path).c_str());
+        abort();
+    }
+
+    std::string path;
+    FILE* f;
+    std::vector<char> buffer;
+    uint64_t bytes_written;
+};
+
+/**
+ * Grava as runs de um processo e as apaga no destrutor.
+ */
+class RunSpiller {
+public:
+    RunSpiller(const std::string& dir, const std::string& prefix, size_t budget_bytes)
+        : dir(dir), prefix(prefix), budget(budget_bytes), bytes_written(0), count_written(0), next_id(0) {}
+
+    ~RunSpiller() {
+        for (size_t i = 0; i < paths.size(); i++) remove(paths[i].c_str());
+    }
+
+    size_t budget_bytes() const { return budget; }
+
+    // Se a contagem já ocupa mais da metade do orçamento, é hora de gravar; a
+    // outra metade fica para o texto da próxima janela e para a gravação
+    bool over_budget(size_t memory_bytes) const { return memory_bytes * 2 > budget; }
+
+    // Grava a contagem como uma nova run e a esvazia
+    void spill(NgramCounts& counts) {
+        spill(counts.vocab, counts.table);
+        counts.vocab = Vocabulary();
+    }
+
+    // Grava a tabela como uma nova run e a esvazia; o vocabulário continua
+    // (pode ser compartilhado com outras tabelas, ver NgramCountSet)
+    void spill(const Vocabulary& vocab, NgramTable& table) {
+        if (table.size() == 0) return;
+
+        std::vector<uint32_t> order(table.size());
+        for (size_t e = 0; e < order.size(); e++) order[e] = (uint32_t)e;
+        std::string a, b;
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) {
+            if (table.hash(x) != table.hash(y)) return table.hash(x) < table.hash(y);
+            NgramCounts::ngram_text_of(vocab, table, x, a); // Colisão de hash: desempata pelo texto
+            NgramCounts::ngram_text_of(vocab, table, y, b);
+            return a < b;
+        });
+
+        std::string path = next_path();
+        RunWriter writer(path);
+        std::string text;
+        for (size_t i = 0; i < order.size(); i++) {
+            NgramCounts::ngram_text_of(vocab, table, order[i], text);
+            writer.write(table.hash(order[i]), table.count(order[i]), text);
+            count_written += table.count(order[i]);
+        }
+        add_run(path, writer.close());
+        table = NgramTable(table.n());
+    }
+
+    // Quantas runs a junção pode abrir de uma vez: os buffers de leitura
+    // ocupam até um quarto do orçamento, com no mínimo 2 e no máximo MAX_MERGE_FAN_IN
+    size_t max_fan_in() const {
+        return std::min(MAX_MERGE_FAN_IN, std::max<size_t>(2, budget / 4 / RUN_READ_BUFFER));
+    }
+
+    // Junção em várias passadas: junta as runs mais antigas em grupos de até
+    // fan_in, cada grupo numa run nova, até sobrarem no máximo fan_in runs
+    // para a junção final. Devolve quantas runs intermediárias foram gravadas.
+    inline size_t merge_runs(size_t fan_in);
+
+    const std::vector<std::string>& runs() const { return paths; }
+    // Bytes nas runs atuais
+    uint64_t bytes() const { return bytes_written; }
+    // Soma das contagens gravadas, ou seja, o total de n-gramas contados
+    uint64_t total_count() const { return count_written; }
+
+private:
+    std::string next_path() { return dir + "/" + prefix + "-" + std::to_string(next_id++) + ".run"; }
+
+    void add_run(const std::string& path, uint64_t bytes) {
+        paths.push_back(path);
+        run_bytes.push_back(bytes);
+        bytes_written += bytes;
+    }
+
+    std::string dir;
+    std::string prefix;
+    size_t budget;
+    uint64_t bytes_written;
+    uint64_t count_written;
+    size_t next_id;
+    std::vector<std::string> paths;
+    std::vector<uint64_t> run_bytes;
+};
+
+/**
+ * Leitura sequencial de uma run.
+ */
+class RunReader {
+public:
+    explicit RunReader(const std::string& path) : buffer(RUN_READ_BUFFER), done(false) {
+        f = fopen(path.c_str(), "rb");
+        if (!f) {
+            perror(path.c_str());
+            abort();
+        }
+        setvbuf(f, &buffer[0], _IOFBF, buffer.size());
+        advance();
+    }
+    ~RunReader() { fclose(f); }
+
+    bool at_end() const { return done; }
+    uint64_t hash() const { return cur_hash; }
+    uint32_t count() const { return cur_count; }
+    const std::string& text() const { return cur_text; }
+
+    void advance() {
+        uint32_t len;
+        if (fread(&cur_hash, sizeof(cur_hash), 1, f) != 1 || fread(&cur_count, sizeof(cur_count), 1, f) != 1 ||
+            fread(&len, sizeof(len), 1, f) != 1) {
+            done = true;
+            return;
+        }
+        cur_text.resize(len);
+        if (len > 0 && fread(&cur_text[0], 1, len, f) != len) done = true;
+    }
+
+private:
+    RunReader(const RunReader&);
+    RunReader& operator=(const RunReader&);
+
+    FILE* f;
+    std::vector<char> buffer;
+    bool done;
+    uint64_t cur_hash;
+    uint32_t cur_count;
+    std::string cur_text;
+};
+
+/**
+ * Junção de k vias das runs: devolve cada n-grama uma vez, com a soma das
+ * contagens de todas as runs, em ordem de (hash, texto).
+ */
+class RunMerger {
+public:
+    explicit RunMerger(const std::vector<std::string>& paths) {
+        for (size_t i = 0; i < paths.size(); i++) {
+            readers.push_back(std::unique_ptr<RunReader>(new RunReader(paths[i])));
+            if (!readers.back()->at_end()) heap.push(i);
+        }
+    }
+
+    bool at_end() const { return heap.empty(); }
+    // Hash do próximo n-grama (só válido se !at_end())
+    uint64_t peek_hash() const { return readers[heap.top()]->hash(); }
+
+    // Próximo n-grama; devolve false quando todas as runs acabaram
+    bool next(uint64_t& hash, std::string& text, uint32_t& count) {
+        if (heap.empty()) return false;
+        size_t r = heap.top();
+        heap.pop();
+        hash = readers[r]->hash();
+        text = readers[r]->text();
+        count = readers[r]->count();
+        pop_and_push(r);
+        while (!heap.empty() && readers[heap.top()]->hash() == hash && readers[heap.top()]->text() == text) {
+            r = heap.top();
+            heap.pop();
+            count += readers[r]->count();
+            pop_and_push(r);
+        }
+        return true;
+    }
+
+private:
+    void pop_and_push(size_t r) {
+        readers[r]->advance();
+        if (!readers[r]->at_end()) heap.push(r);
+    }
+
+    struct Greater {
+        const std::vector<std::unique_ptr<RunReader> >* readers;
+        bool operator()(size_t a, size_t b) const {
+            const RunReader& x = *(*readers)[a];
+            const RunReader& y = *(*readers)[b];
+            if (x.hash() != y.hash()) return x.hash() > y.hash();
+            return x.text() > y.text();
+        }
+    };
+
+    std::vector<std::unique_ptr<RunReader> > readers;
+    std::priority_queue<size_t, std::vector<size_t>, Greater> heap{ Greater{ &readers } };
+};
+
+inline size_t RunSpiller::merge_runs(size_t fan_in) {
+    fan_in = std::max<size_t>(fan_in, 2);
+    size_t merges = 0;
+    while (paths.size() > fan_in) {
+        // O último grupo só precisa ser grande o bastante para sobrarem fan_in runs
+        size_t group = std::min(fan_in, paths.size() - fan_in + 1);
+        std::vector<std::string> inputs(paths.begin(), paths.begin() + group);
+        std::string path = next_path();
+        {
+            RunMerger merger(inputs);
+            RunWriter writer(path);
+            uint64_t hash;
+            std::string text;
+            uint32_t count;
+            while (merger.next(hash, text, count)) writer.write(hash, count, text);
+            for (size_t i = 0; i < group; i++) bytes_written -= run_bytes[i];
+            paths.erase(paths.begin(), paths.begin() + group);
+            run_bytes.erase(run_bytes.begin(), run_bytes.begin() + group);
+            add_run(path, writer.close());
+        }
+        for (size_t i = 0; i < inputs.size(); i++) remove(inputs[i].c_str());
+        merges++;
+    }
+    return merges;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#!/bin/bash
+# Teste de regressão: os n-gramas significativos do parallel, em todos os
+# modos de leitura e de redução exatos e com P = 1..4, têm de ser os mesmos
+# do ngrams (serial). --reduce sketch é aproximado e só entra com um resumo
+# maior que o número de n-gramas distintos, em que fica exato. No fim,
+# confere que --prefilter de fato diminui os bytes enviados (--stats).
+#
+# Uso: make check   (ou tests/check.sh, da raiz do repositório)
+#
+# Variáveis de ambiente (padrões entre parênteses):
+#   PROCS    valores de P ("1 2 3 4")
+#   NS       tamanhos de n-grama testados ("1 3 5")
+#   INPUT    texto de entrada (DomCasmurro.txt)
+#   MPIRUN   comando do mpirun ("mpirun --oversubscribe")
+
+PROCS=${PROCS:-"1 2 3 4"}
+NS=${NS:-"1 3 5"}
+INPUT=${INPUT:-DomCasmurro.txt}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+
+for bin in ./ngrams ./parallel; do
+    if [ ! -x "$bin" ]; then
+        echo "$bin não encontrado; rode make check" >&2
+        exit 1
+    fi
+done
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# Blocos e limiar de conquista pequenos, para que a entrada de teste seja
+# cortada em muitos pedaços também com poucos processos
+COMMON="--print --char-threshold 20000 --block-size 9999"
+REDUCTIONS=("--reduce tree" "--reduce shuffle" "--reduce node" "--reduce tree --prefilter" "--reduce shuffle --prefilter")
+# Com P >= 4 o MPI pode reduzir o resumo Space-Saving em pedaços (allreduce em
+# anel), o que quebraria um MPI_Op que não recebesse o resumo inteiro
+SKETCH="--reduce sketch --sketch-top-k 200000 --sketch-verify 0"
+SKETCH_PROCS="4 6"
+
+failures=0
+runs=0
+for n in $NS; do
+    ./ngrams --n "$n" "$INPUT" | grep "^'" | sort > "$TMP/serial.txt"
+    for read in tree ranges blocks; do
+        for reduce in "${REDUCTIONS[@]}"; do
+            for p in $PROCS; do
+                runs=$((runs + 1))
+                $MPIRUN -np "$p" ./parallel --n "$n" --read "$read" $reduce $COMMON "$INPUT" 2> "$TMP/stderr.txt" |
+                    grep "^'" | sort > "$TMP/parallel.txt"
+                if ! cmp -s "$TMP/serial.txt" "$TMP/parallel.txt"; then
+                    echo "FALHOU: -np $p --n $n --read $read $reduce"
+                    diff "$TMP/serial.txt" "$TMP/parallel.txt" | head -5
+                    failures=$((failures + 1))
+                fi
+            done
+        done
+    done
+    for p in $SKETCH_PROCS; do
+        runs=$((runs + 1))
+        $MPIRUN -np "$p" ./parallel --n "$n" $SKETCH $COMMON "$INPUT" 2> "$TMP/stderr.txt" |
+            grep "^'" | sort > "$TMP/parallel.txt"
+        if ! cmp -s "$TMP/serial.txt" "$TMP/parallel.txt"; then
+            echo "FALHOU: -np $p --n $n $SKETCH"
+            diff "$TMP/serial.txt" "$TMP/parallel.txt" | head -5
+            failures=$((failures + 1))
+        fi
+    done
+done
+
+# O sketch do filtro vai a todos os processos; com ele, a média de bytes
+# enviados por processo (sketch + candidatos) tem de ficar abaixo da redução
+# sem filtro, com 4 processos e o N padrão
+bytes_sent() {
+    $MPIRUN -np 4 ./parallel --stats "$@" "$INPUT" 2> /dev/null | awk '/^bytes enviados/ { print $(NF - 3) }'
+}
+for reduce in "--reduce tree" "--reduce shuffle"; do
+    runs=$((runs + 2))
+    without=$(bytes_sent $reduce)
+    with=$(bytes_sent $reduce --prefilter)
+    if ! awk -v a="$with" -v b="$without" 'BEGIN { exit !(a != "" && b != "" && a + 0 < b + 0) }'; then
+        echo "FALHOU: $reduce --prefilter envia $with bytes por processo, sem o filtro $without"
+        failures=$((failures + 1))
+    fi
+done
+
+if [ "$failures" -gt 0 ]; then
+    echo "$failures de $runs verificações falharam"
+    exit 1
+fi
+echo "OK: $runs execuções iguais ao serial e --prefilter enviando menos"
@@ -0,0 +1,271 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ngram_table.h"
+#include "normalize.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZER_X86 1
+#else
+#define TOKENIZER_X86 0
+#endif
+
+/**
+ * Tokenizador com as mesmas regras do ngrams.c: palavras separadas por
+ * ' ', '\n', '\t' ou '\r', das quais só as letras são mantidas (em
+ * minúsculo); palavras sem letras são descartadas. O que conta como letra
+ * depende do modo de normalização (ver normalize.h).
+ *
+ * O trabalho é feito em duas etapas:
+ *  1. WordScanner acha as palavras (início, fim) classificando 64 bytes por
+ *     vez: uma máscara de bits dos separadores é montada com SSE2 ou AVX2, e
+ *     inícios/fins de palavra saem de operações de bits sobre ela.
+ *  2. normalize_word remove o que não é letra e converte para minúsculo,
+ *     16 bytes por vez com SSE2 quando a palavra cabe num registrador e é
+ *     só ASCII; as demais passam pelo caminho de tabela de normalize.h.
+ * A versão (escalar, SSE2 ou AVX2) é escolhida em tempo de execução.
+ */
+
+// Mesmos separadores do strsep em ngrams.c, para que as contagens sejam idênticas
+inline bool is_separator(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+enum TokenizerKind { TOKENIZER_SCALAR, TOKENIZER_SSE2, TOKENIZER_AVX2 };
+
+inline const char* tokenizer_name(TokenizerKind kind) {
+    switch (kind) {
+        case TOKENIZER_AVX2: return "AVX2";
+        case TOKENIZER_SSE2: return "SSE2";
+        default: return "escalar";
+    }
+}
+
+// A melhor versão suportada por esta CPU
+inline TokenizerKind best_tokenizer() {
+#if TOKENIZER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return TOKENIZER_AVX2;
+    if (__builtin_cpu_supports("sse2")) return TOKENIZER_SSE2;
+#endif
+    return TOKENIZER_SCALAR;
+}
+
+struct WordSpan {
+    size_t start;
+    size_t end;
+};
+
+/**
+ * Percorre o texto devolvendo as palavras (sequências sem separador) em lotes.
+ */
+class WordScanner {
+public:
+    WordScanner(std::string_view text, TokenizerKind kind)
+        : text(text), kind(kind), pos(0), in_word(false), word_start(0) {}
+
+    // Preenche até max_spans palavras (max_spans >= 64); devolve 0 no fim do texto
+    size_t next(WordSpan* spans, size_t max_spans) {
+        size_t n = 0;
+#if TOKENIZER_X86
+        if (kind == TOKENIZER_AVX2) n = scan_avx2(spans, max_spans);
+        else if (kind == TOKENIZER_SSE2) n = scan_sse2(spans, max_spans);
+#endif
+        // Resto que não forma um bloco de 64 bytes (ou tudo, no modo escalar)
+        while (n < max_spans && pos < text.length()) {
+            bool sep = is_separator(text[pos]);
+            if (in_word && sep) {
+                spans[n].start = word_start;
+                spans[n].end = pos;
+                n++;
+                in_word = false;
+            } else if (!in_word && !sep) {
+                in_word = true;
+                word_start = pos;
+            }
+            pos++;
+        }
+        if (n < max_spans && pos == text.length() && in_word) {
+            spans[n].start = word_start;
+            spans[n].end = pos;
+            n++;
+            in_word = false;
+        }
+        return n;
+    }
+
+private:
+    // Consome um bloco de 64 bytes a partir da máscara dos separadores
+    inline size_t consume_block(uint64_t sep, WordSpan* spans, size_t n) {
+        uint64_t nonsep = ~sep;
+        // Bit i de `starts`: byte i começa uma palavra; de `ends`: byte i termina uma
+        uint64_t starts = nonsep & ((sep << 1) | (in_word ? 0 : 1));
+        uint64_t ends = sep & ((nonsep << 1) | (in_word ? 1 : 0));
+        while (starts | ends) {
+            if (in_word) {
+                if (!ends) break;
+                int i = __builtin_ctzll(ends);
+                ends &= ends - 1;
+                spans[n].start = word_start;
+                spans[n].end = pos + i;
+                n++;
+                in_word = false;
+            } else {
+                int i = __builtin_ctzll(starts);
+                starts &= starts - 1;
+                word_start = pos + i;
+                in_word = true;
+            }
+        }
+        pos += 64;
+        return n;
+    }
+
+#if TOKENIZER_X86
+    __attribute__((target("sse2")))
+    size_t scan_sse2(WordSpan* spans, size_t max_spans) {
+        const __m128i space = _mm_set1_epi8(' '), nl = _mm_set1_epi8('\n');
+        const __m128i tab = _mm_set1_epi8('\t'), cr = _mm_set1_epi8('\r');
+        size_t n = 0;
+        // Um bloco gera no máximo 32 palavras
+        while (pos + 64 <= text.length() && n + 32 <= max_spans) {
+            uint64_t sep = 0;
+            for (int k = 0; k < 4; k++) {
+                __m128i c = _mm_loadu_si128((const __m128i*)(text.data() + pos + 16 * k));
+                __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_cmpeq_epi8(c, nl)),
+                                         _mm_or_si128(_mm_cmpeq_epi8(c, tab), _mm_cmpeq_epi8(c, cr)));
+                sep |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << (16 * k);
+            }
+            n = consume_block(sep, spans, n);
+        }
+        return n;
+    }
+
+    __attribute__((target("avx2")))
+    size_t scan_avx2(WordSpan* spans, size_t max_spans) {
+        const __m256i space = _mm256_set1_epi8(' '), nl = _mm256_set1_epi8('\n');
+        const __m256i tab = _mm256_set1_epi8('\t'), cr = _mm256_set1_epi8('\r');
+        size_t n = 0;
+        while (pos + 64 <= text.length() && n + 32 <= max_spans) {
+            uint64_t sep = 0;
+            for (int k = 0; k < 2; k++) {
+                __m256i c = _mm256_loadu_si256((const __m256i*)(text.data() + pos + 32 * k));
+                __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(c, space), _mm256_cmpeq_epi8(c, nl)),
+                                            _mm256_or_si256(_mm256_cmpeq_epi8(c, tab), _mm256_cmpeq_epi8(c, cr)));
+                sep |= (uint64_t)(uint32_t)_mm256_movemask_epi8(m) << (32 * k);
+            }
+            n = consume_block(sep, spans, n);
+        }
+        return n;
+    }
+#endif
+
+    std::string_view text;
+    TokenizerKind kind;
+    size_t pos;
+    bool in_word;
+    size_t word_start;
+};
+
+/**
+ * Copia para `out` a forma normalizada de text[start, end) (ver norm_word) e
+ * devolve seu tamanho. `out` precisa de espaço para 2 * (end - start) + 16 bytes.
+ */
+inline size_t normalize_word(std::string_view text, size_t start, size_t end, TokenizerKind kind, int normalization,
+                             char* out) {
+    size_t len = end - start;
+#if TOKENIZER_X86
+    // Caso comum: palavra curta, com 16 bytes legíveis a partir do início
+    if (kind != TOKENIZER_SCALAR && len <= 16 && start + 16 <= text.length()) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(text.data() + start));
+        uint32_t word_bits = (len == 16) ? 0xFFFFu : ((1u << len) - 1);
+        // Bytes >= 0x80 (acentos em UTF-8/Latin-1) ficam com o caminho de tabela
+        bool ascii = normalization == NORM_ASCII || (_mm_movemask_epi8(c) & word_bits) == 0;
+        if (ascii) {
+            __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+            // 'a' <= lower <= 'z', com comparações com sinal (bytes >= 0x80 ficam de fora)
+            __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+            uint32_t alpha_bits = (uint32_t)_mm_movemask_epi8(alpha);
+            if ((alpha_bits & word_bits) == word_bits) {
+                // Só letras: minúsculo no registrador e uma única escrita
+                _mm_storeu_si128((__m128i*)out, lower);
+                return len;
+            }
+            char tmp[16];
+            _mm_storeu_si128((__m128i*)tmp, lower);
+            size_t n = 0;
+            for (uint32_t bits = alpha_bits & word_bits; bits; bits &= bits - 1) {
+                out[n++] = tmp[__builtin_ctz(bits)];
+            }
+            return n;
+        }
+    }
+#endif
+    return norm_word(text.data() + start, len, normalization, out);
+}
+
+/**
+ * Converte cada palavra do texto para seu ID no vocabulário, sem alocar uma
+ * string por token. Se owned_tokens não for nulo, recebe quantos tokens
+ * começam antes de owned_chars (ou seja, pertencem à faixa deste processo).
+ */
+inline std::vector<uint32_t> tokenize_optimized(std::string_view text, Vocabulary& vocab, TokenizerKind kind,
+                                                int normalization, size_t owned_chars = std::string::npos, size_t* owned_tokens = NULL) {
+    std::vector<uint32_t> tokens;
+    tokens.reserve(text.length() / 5);
+    size_t owned = 0;
+
+    const size_t BATCH = 1024;
+    WordSpan spans[BATCH];
+    std::vector<char> word(2 * 256 + 16); // +16: normalize_word pode escrever 16 bytes
+    WordScanner scanner(text, kind);
+    size_t n;
+    while ((n = scanner.next(spans, BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            size_t len = spans[i].end - spans[i].start;
+            if (2 * len + 16 > word.size()) word.resize(2 * len + 16);
+            size_t word_len = normalize_word(text, spans[i].start, spans[i].end, kind, normalization, &word[0]);
+            if (word_len == 0) continue;
+            if (spans[i].start < owned_chars) owned++;
+            tokens.push_back(vocab.intern(&word[0], word_len));
+        }
+    }
+    if (owned_tokens) *owned_tokens = owned;
+    return tokens;
+}
+
+/**
+ * A partir de pos, termina a palavra corrente (se pos cair no meio de uma)
+ * e avança mais num_tokens tokens completos. Retorna a posição logo após o
+ * último deles, ou string::npos se o texto acabar antes disso
+ * (a menos que at_eof indique que não há mais nada a ler).
+ */
+inline size_t find_lookahead_end(std::string_view text, size_t pos, int num_tokens, bool at_eof, int normalization) {
+    size_t len = text.length();
+    if (pos > 0) {
+        while (pos < len && !is_separator(text[pos - 1]) && !is_separator(text[pos])) pos++;
+        // A palavra corrente pode continuar depois do fim do texto lido
+        if (pos == len && !at_eof && !is_separator(text[pos - 1])) return std::string::npos;
+    }
+    int found = 0;
+    while (found < num_tokens) {
+        while (pos < len && is_separator(text[pos])) pos++;
+        if (pos == len) return at_eof ? len : std::string::npos;
+        size_t word_start = pos;
+        while (pos < len && !is_separator(text[pos])) pos++;
+        bool has_alpha = norm_has_letter(text.data() + word_start, pos - word_start, normalization);
+        // Uma palavra só está completa se vier um separador depois dela (ou EOF)
+        if (pos == len && !at_eof) return std::string::npos;
+        if (has_alpha) found++;
+    }
+    return pos;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stddef.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Pool de threads com roubo de tarefas ("work stealing"), para dividir o
+ * trabalho de um processo MPI entre os núcleos da máquina.
+ *
+ * As tarefas 0..num_tasks-1 começam distribuídas em blocos contíguos, uma
+ * fila por thread. Cada thread consome a frente da própria fila e, quando
+ * ela esvazia, rouba do fim da fila de outra. Assim um bloco de texto mais
+ * lento não deixa as outras threads paradas.
+ */
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int num_threads) : queues(num_threads > 0 ? num_threads : 1) {}
+
+    int size() const { return (int)queues.size(); }
+
+    // Executa task(thread, tarefa) para todas as tarefas e espera o fim
+    void run(size_t num_tasks, const std::function<void(int, size_t)>& task) {
+        int n = size();
+        for (int t = 0; t < n; t++) {
+            size_t begin = num_tasks * t / n, end = num_tasks * (t + 1) / n;
+            for (size_t i = begin; i < end; i++) queues[t].tasks.push_back(i);
+        }
+        std::vector<std::thread> workers;
+        for (int t = 1; t < n; t++) {
+            workers.push_back(std::thread(&WorkStealingPool::work, this, t, std::cref(task)));
+        }
+        work(0, task); // A thread chamadora também trabalha
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    }
+
+    /**
+     * Redução em árvore sobre os resultados das threads: na rodada k, o
+     * resultado t absorve o t + 2^k, com as junções de cada rodada em paralelo.
+     * Ao final tudo está em results[0].
+     */
+    template <class T>
+    static void reduce(std::vector<T>& results, const std::function<void(T&, T&)>& merge) {
+        for (size_t stride = 1; stride < results.size(); stride *= 2) {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t + stride < results.size(); t += 2 * stride) {
+                workers.push_back(std::thread(merge, std::ref(results[t]), std::ref(results[t + stride])));
+            }
+            for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    bool pop_own(int t, size_t& task) {
+        std::lock_guard<std::mutex> guard(queues[t].lock);
+        if (queues[t].tasks.empty()) return false;
+        task = queues[t].tasks.front();
+        queues[t].tasks.pop_front();
+        return true;
+    }
+
+    bool steal(int t, size_t& task) {
+        int n = size();
+        for (int k = 1; k < n; k++) {
+            Queue& victim = queues[(t + k) % n];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(int t, const std::function<void(int, size_t)>& task) {
+        size_t i;
+        while (pop_own(t, i) || steal(t, i)) task(t, i);
+    }
+
+    std::vector<Queue> queues;
+};
+
+#endif